@@ -21,13 +21,99 @@
 #define __JANERT_PIXELSCALERS_BITMAP__
 
 #include <cstdint>
+#include <fstream>
 #include <string>
 
+// A file name of "-" stands for standard input or output, throughout. Pipes
+// are read and written front to back, a few rows at a time.
+
+// Opens fileName for writing, or returns std::cout for "-"; NULL on error.
+std::ostream *openOutput( const std::string &fileName, std::ofstream &file );
+int closeOutput( std::ostream *output, std::ofstream &file );
+
+// Writes a 24-bit BMP, bottom up (the usual row order) or top down.
 int saveBitmap(	const uint32_t *data, uint32_t width, uint32_t height,
-		const std::string &fileName );
+		const std::string &fileName, bool topDown = false );
+
+// Writes a 24-bit BMP a few rows at a time, in file order, so that the
+// image never has to be in memory as a whole; with a top-down file, that
+// is the order in which the scalers produce them.
+class BitmapWriter {
+public:
+  BitmapWriter() : output(NULL), buf(NULL) {}
+  ~BitmapWriter();
+
+  int open( const std::string &fileName, uint32_t width, uint32_t height,
+	    bool topDown );
+  void write( const uint32_t *rows, uint32_t n );	// the next n rows
+  int close();
+
+private:
+  void flush();
+
+  std::ofstream file;
+  std::ostream *output;
+  uint32_t width, rowBytes;
+  uint32_t capacity, used;	// rows in the staging buffer
+  uint8_t *buf;
+};
+// The loaders take 24-bit and 32-bit files, bottom up or top down, with
+// any header version; alpha is kept if the file has it, and set to 0xFF
+// otherwise.
 int loadBitmap(	const std::string &fileName, uint32_t *&data,
-		uint16_t &width, uint16_t &height );
+		uint32_t &width, uint32_t &height );
 int loadBitmapPadded( const std::string &fileName, uint32_t *&data,
-		      uint16_t &width, uint16_t &height, uint16_t pad );
+		      uint32_t &width, uint32_t &height, int pad );
+
+// Fills the padding around a width x height image, stored as loaded by
+// loadBitmapPadded(), with the nearest image pixels. For other loaders,
+// and for index planes.
+void fillPadding( uint32_t *data, uint32_t width, uint32_t height, int pad );
+void fillPadding( uint8_t *data, uint32_t width, uint32_t height, int pad );
+
+// Palettized files (1, 4, or 8 bits per pixel) are expanded to 32 bits by
+// the loaders above. This one keeps them as they are instead: a palette of
+// up to 256 colors, and one index byte per pixel, padded like data would
+// be, a quarter of the memory. data is then NULL. Any other file is loaded
+// into data as by loadBitmapPadded(), with index NULL and colors 0. The
+// index plane is freed with delete[].
+int loadIndexedBitmap( const std::string &fileName, uint32_t *&data,
+		       uint8_t *&index, uint32_t *palette, int &colors,
+		       uint32_t &width, uint32_t &height, int pad );
+
+// Expands an index plane of n pixels to 32 bits through palette, into a
+// new image that is freed with releaseBitmap(); NULL if out of memory.
+uint32_t *expandIndexed( const uint8_t *index, const uint32_t *palette,
+			 size_t n );
+
+// Writes an 8-bit palettized BMP; alpha is dropped from the palette.
+int saveIndexedBitmap( const uint8_t *index, const uint32_t *palette,
+		       int colors, uint32_t width, uint32_t height,
+		       const std::string &fileName, bool topDown = false );
+
+// Maps each of n pixels to its index in palette, which has room for 256
+// colors, the first "colors" of them already taken; new colors are added.
+// Alpha is ignored. Returns -1 if more than 256 colors are needed.
+int indexBitmap( const uint32_t *data, long n, uint8_t *index,
+		 uint32_t *palette, int &colors );
+
+// Header written by mapBitmap(): BITMAPINFOHEADER, which has no alpha
+// channel, BITMAPV4HEADER or BITMAPV5HEADER, which use BI_BITFIELDS to
+// declare one, or none at all.
+enum BitmapHeaderVersion { BMP_INFO, BMP_V4, BMP_V5, BMP_NONE };
+
+// Creates fileName as a 32-bit top-down BMP for a width x height image, or
+// as bare BGRA pixels for BMP_NONE, and maps it into memory. Returns the
+// mapped pixel array, to be filled in place, or NULL on error.
+uint32_t *mapBitmap( const std::string &fileName, uint32_t width,
+		     uint32_t height, BitmapHeaderVersion version );
+
+// Frees an image returned by the loaders above, or unmaps one returned by
+// mapBitmap(), which leaves its contents in the file.
+void releaseBitmap( uint32_t *data );
+
+// True if all n pixels have alpha 0xFF, as for any file without alpha.
+// Scalers use this to pick kernels that skip the alpha channel.
+bool isOpaque( const uint32_t *data, long n );
 
 #endif
@@ -28,8 +28,12 @@
 #include <cstdint>
 
 uint32_t ARGBtoAYUV( uint32_t value );
+
+// The opaque variants ignore alpha; instantiated for both in hqx.cc.
+template<bool opaque>
 bool isDifferentA( uint32_t color1, uint32_t color2,
 		   uint32_t trY, uint32_t trU, uint32_t trV, uint32_t trA );
+template<bool opaque>
 bool isDifferentB( uint32_t color1, uint32_t color2,
 		   uint32_t trY, uint32_t trU, uint32_t trV, uint32_t trA );
 
@@ -42,19 +46,26 @@ bool isDifferentB( uint32_t color1, uint32_t color2,
 
 /**
  * @brief Mixes two colors using the given weights.
+ *
+ * PKJ: Expects a compile-time bool "opaque" in scope. If it is set, all
+ * colors have alpha 0xFF and so does the mix, which is not computed.
  */
 #define HQX_MIX_2(C0,C1,W0,W1) \
 	((((C0 & MASK_RB) * W0 + (C1 & MASK_RB) * W1) / (W0 + W1)) & MASK_RB) | \
 	((((C0 & MASK_G)  * W0 + (C1 & MASK_G)  * W1) / (W0 + W1)) & MASK_G)  | \
-	((((((C0 & MASK_A) >> 8)  * W0 + ((C1 & MASK_A) >> 8) * W1) / (W0 + W1)) << 8) & MASK_A)
+	(opaque ? MASK_A : \
+	((((((C0 & MASK_A) >> 8)  * W0 + ((C1 & MASK_A) >> 8) * W1) / (W0 + W1)) << 8) & MASK_A))
 
 /**
  * @brief Mixes three colors using the given weights.
+ *
+ * PKJ: Same as HQX_MIX_2 regarding "opaque".
  */
 #define HQX_MIX_3(C0,C1,C2,W0,W1,W2) \
 	((((C0 & MASK_RB) * W0 + (C1 & MASK_RB) * W1 + (C2 & MASK_RB) * W2) / (W0 + W1 + W2)) & MASK_RB) | \
 	((((C0 & MASK_G)  * W0 + (C1 & MASK_G)  * W1 + (C2 & MASK_G)  * W2) / (W0 + W1 + W2)) & MASK_G)  | \
-	((((((C0 & MASK_A) >> 8) * W0 + ((C1 & MASK_A) >> 8) * W1 + ((C2 & MASK_A) >> 8) * W2) / (W0 + W1 + W2)) << 8) & MASK_A)
+	(opaque ? MASK_A : \
+	((((((C0 & MASK_A) >> 8) * W0 + ((C1 & MASK_A) >> 8) * W1 + ((C2 & MASK_A) >> 8) * W2) / (W0 + W1 + W2)) << 8) & MASK_A))
 
 
 #define MIX_00_4				*output = w[4];
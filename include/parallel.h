@@ -0,0 +1,46 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef __JANERT_PIXELSCALERS_PARALLEL__
+#define __JANERT_PIXELSCALERS_PARALLEL__
+
+#include <functional>
+
+// Number of worker threads used by the multi-threaded scalers. Zero (the
+// default) means one thread per hardware core.
+void setThreadCount( int n );
+int threadCount();
+
+// Runs fn(t, n) on n = threadCount() threads, t = 0, ..., n-1, and returns
+// once all of them have finished.
+void parallelRun( const std::function<void(int, int)> &fn );
+
+// Splits [begin, end) into one contiguous band per thread and runs
+// fn(bandBegin, bandEnd) on each band concurrently.
+void parallelBands( int begin, int end,
+		    const std::function<void(int, int)> &fn );
+
+#endif
@@ -0,0 +1,67 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef __JANERT_PIXELSCALERS_PNM__
+#define __JANERT_PIXELSCALERS_PNM__
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Netpbm images, 8 bits per sample: PPM (P6) and PAM (P7). Both are a
+// short text header followed by the rows, top down and unpadded, so they
+// are read and written a row at a time, and go through pipes as well as
+// files ("-" is standard input or output, as for BMP).
+
+// Like loadBitmapPadded(): loads a PPM, or a PAM of depth 1 to 4
+// (grayscale or RGB, with or without alpha), with "pad" pixels of padding
+// on all four sides. Free with releaseBitmap().
+int loadPnmPadded( const std::string &fileName, uint32_t *&data,
+		   uint32_t &width, uint32_t &height, int pad );
+
+// Writes a PPM, or a PAM with alpha (tuple type RGB_ALPHA), a few rows at
+// a time, top down.
+class PnmWriter {
+public:
+  PnmWriter() : output(NULL) {}
+
+  int open( const std::string &fileName, uint32_t width, uint32_t height,
+	    bool alpha );
+  void write( const uint32_t *rows, uint32_t n );	// the next n rows
+  int close();
+
+private:
+  void flush();
+
+  std::ofstream file;
+  std::ostream *output;
+  uint32_t width, depth;
+  uint32_t capacity, used;	// rows in the staging buffer
+  std::vector<uint8_t> buf;
+};
+
+#endif
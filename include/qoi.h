@@ -0,0 +1,70 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef __JANERT_PIXELSCALERS_QOI__
+#define __JANERT_PIXELSCALERS_QOI__
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// The "Quite OK Image" format (https://qoiformat.org): lossless, like
+// PNG, but a single pass over the pixels with a 64-entry color cache, so
+// it encodes and decodes about as fast as the pixels can be moved. Rows
+// are coded top down, one after the other, so files stream like netpbm
+// ones ("-" is standard input or output).
+
+// Like loadBitmapPadded(): loads a QOI file, RGB or RGBA, with "pad" pixels
+// of padding on all four sides. Free with releaseBitmap().
+int loadQoiPadded( const std::string &fileName, uint32_t *&data,
+		   uint32_t &width, uint32_t &height, int pad );
+
+// Writes a QOI file a few rows at a time. Without alpha, the file is
+// marked as RGB and all pixels are written opaque.
+class QoiWriter {
+public:
+  QoiWriter() : output(NULL) {}
+
+  int open( const std::string &fileName, uint32_t width, uint32_t height,
+	    bool alpha );
+  void write( const uint32_t *rows, uint32_t n );	// the next n rows
+  int close();
+
+private:
+  void flush();
+
+  std::ofstream file;
+  std::ostream *output;
+  uint32_t width;
+  uint32_t opaque;		// ORed into every pixel
+  uint32_t prev, index[64];	// encoder state
+  int run;
+  std::vector<uint8_t> buf;	// staging buffer
+  size_t used;
+};
+
+#endif
@@ -0,0 +1,85 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef __JANERT_PIXELSCALERS_RESAMPLE__
+#define __JANERT_PIXELSCALERS_RESAMPLE__
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Resamples an image to an arbitrary size, one source row at a time, so
+// that the source never has to be held in memory as a whole.
+//
+// Area averages every source pixel an output pixel covers (a box
+// filter); Bilinear interpolates between the four nearest source pixels.
+// Used after an integer pixel scaler, the latter gives the "sharp
+// bilinear" look: the blur is confined to a fraction of a source pixel.
+//
+// Colors are weighted by alpha, so that the color of a transparent pixel
+// does not bleed into its visible neighbors.
+class RowResampler {
+public:
+  enum Filter { Area, Bilinear };
+
+  // Output rows, outW pixels each, are passed to sink, top to bottom.
+  // Without alpha, the source is taken to be opaque, and the weighting by
+  // alpha is skipped.
+  RowResampler( Filter filter, int srcW, int srcH, int outW, int outH,
+		bool alpha, const std::function<void(const uint32_t*)> &sink );
+
+  // Feeds the next source row, srcW pixels; rows must arrive top to
+  // bottom. Each output row goes to the sink as soon as all of its source
+  // rows are in, so only a few rows are ever held here.
+  void push( const uint32_t *row );
+
+private:
+  // For each output column (or row): the first source pixel it draws
+  // from, how many, and where their weights start in weight.
+  struct Taps {
+    std::vector<int> start, count, offset;
+    std::vector<float> weight;
+  };
+
+  static void areaTaps( int src, int dst, Taps &t );
+  static void bilinearTaps( int src, int dst, Taps &t );
+
+  int srcW, outW, outH;
+  bool alpha;
+  std::function<void(const uint32_t*)> sink;
+  Taps cols, rows;
+
+  int srcRow;			// next source row expected
+  int firstOpen, nextOpen;	// output rows being accumulated
+  int ring;			// max number of rows open at once
+
+  // with alpha, the colors in these are premultiplied
+  std::vector<float> hrow;	// current source row, resampled to outW
+  std::vector<float> acc;	// ring of open output rows
+  std::vector<uint32_t> orow;	// output row being handed to the sink
+};
+
+#endif
@@ -0,0 +1,42 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef __JANERT_PIXELSCALERS_ROTSPRITE__
+#define __JANERT_PIXELSCALERS_ROTSPRITE__
+
+#include <cstdint>
+
+// Rotation angle in degrees, counterclockwise. Defaults to 0.
+void setRotSpriteAngle( double degrees );
+
+// Size of the rotated image: the bounding box of the rotated input.
+void rotSpriteSize( int w, int h, int &outW, int &outH );
+
+// Rotates a w x h image (no padding) into out, which must be of the size
+// returned by rotSpriteSize(). Pixels outside the rotated input are 0.
+void rotSprite( uint32_t *img, int w, int h, uint32_t *out );
+
+#endif
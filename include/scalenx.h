@@ -32,9 +32,22 @@ void copy( uint32_t *img, int w, int h, uint32_t *out );
 void block2( uint32_t *img, int w, int h, uint32_t *out );
 void block3( uint32_t *img, int w, int h, uint32_t *out );
 void scale2x( uint32_t *img, int W, int H, uint32_t *out );
-void scale2xPad( uint32_t *img, uint16_t W, uint16_t H, uint32_t *out );
+void scale2xPad( uint32_t *img, int W, int H, uint32_t *out );
 void scale2xSFX( uint32_t *img, int w, int h, uint32_t *out );
-void scale3xPad( uint32_t *img, uint16_t w, uint16_t h, uint32_t *out );
-void scale3xSFX( uint32_t *img, uint16_t w, uint16_t h, uint32_t *out );
+void mmpx2x( uint32_t *img, int w, int h, uint32_t *out );
+void scale3xPad( uint32_t *img, int w, int h, uint32_t *out );
+void scale3xSFX( uint32_t *img, int w, int h, uint32_t *out );
+
+// Versions of the scalers that only copy colors, for palettized images:
+// img and out hold one palette index per pixel. MMPX breaks ties by
+// brightness, which it looks up in the palette.
+void copy( uint8_t *img, int w, int h, uint8_t *out );
+void block2( uint8_t *img, int w, int h, uint8_t *out );
+void block3( uint8_t *img, int w, int h, uint8_t *out );
+void scale2x( uint8_t *img, int W, int H, uint8_t *out );
+void scale2xPad( uint8_t *img, int W, int H, uint8_t *out );
+void mmpx2x( uint8_t *img, int w, int h, uint8_t *out,
+	     const uint32_t *palette );
+void scale3xPad( uint8_t *img, int w, int h, uint8_t *out );
 
 #endif
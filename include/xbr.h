@@ -36,6 +36,24 @@ by Philipp K. Janert, September 2022
 #include <cstdint>
 
 void scaleSuperXBR(uint32_t* data, int w, int h, uint32_t* out);
+void scaleSuperXBR4x(uint32_t* data, int w, int h, uint32_t* out);
+void scaleSuperXBR8x(uint32_t* data, int w, int h, uint32_t* out);
+
+// Integer xBR; input requires 2px padding on all four sides.
+void scaleXBR2x(uint32_t* data, int w, int h, uint32_t* out);
+void scaleXBR3x(uint32_t* data, int w, int h, uint32_t* out);
+void scaleXBR4x(uint32_t* data, int w, int h, uint32_t* out);
+
+// Level of the integer xBR rules: 2 (default) or 3.
+void setXBRLevel(int level);
+
+// Fast preset: skip the third pass (off by default).
+void setSuperXBRFast(bool on);
+
+// Optional cache of filter results for repeated windows (off by default).
+// The stats give lookups and hits per pass, summed over all runs so far.
+void setSuperXBRMemo(bool on);
+void superXBRMemoStats(long lookups[3], long hits[3]);
 
 #endif
 
@@ -0,0 +1,28 @@
+/*
+
+xBRZ: "Scale by rules" - high quality image upscaling filter by Zenju.
+Copyright (C) Zenju. Licensed under the GNU General Public License,
+version 3 or later: https://www.gnu.org/licenses/gpl-3.0.html
+
+Adapted from
+    https://sourceforge.net/projects/xbrz/
+for the pixelscaler driver.
+
+Note that, unlike most of this project, xbrz.h and xbrz.cc are covered
+by the GPL, and so is any binary that includes them.
+
+*/
+
+#ifndef __JANERT_PIXELSCALERS_XBRZ__
+#define __JANERT_PIXELSCALERS_XBRZ__
+
+#include <cstdint>
+
+// All require 2px padding on all four sides.
+void scaleXBRZ2x(uint32_t* data, int w, int h, uint32_t* out);
+void scaleXBRZ3x(uint32_t* data, int w, int h, uint32_t* out);
+void scaleXBRZ4x(uint32_t* data, int w, int h, uint32_t* out);
+void scaleXBRZ5x(uint32_t* data, int w, int h, uint32_t* out);
+void scaleXBRZ6x(uint32_t* data, int w, int h, uint32_t* out);
+
+#endif
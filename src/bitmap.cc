@@ -18,14 +18,27 @@
  */
 
 #include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
 #include <cstdlib>
 #include <cstdint>
 #include <string>
+#include <new>
 
 #include "bitmap.h"
+#include "parallel.h"
 
-using std::ifstream;
-using std::ofstream;
 using std::string;
 
 #pragma pack(push, 1)
@@ -41,8 +54,8 @@ struct BitmapHeader
 struct DibHeader
 {
 	uint32_t biSize;
-	uint32_t biWidth;
-	uint32_t biHeight;
+	int32_t  biWidth;
+	int32_t  biHeight;
 	uint16_t biPlanes;
 	uint16_t biBitCount;
 	uint32_t biCompression;
@@ -55,159 +68,703 @@ struct DibHeader
 
 #pragma pack(pop)
 
-// Writes a Windows Bitmap image (BMP3, 24 bits) data structure from raw data
-int saveBitmap(	const uint32_t *data, uint32_t width, uint32_t height,
-		const string &fileName ) {
-	BitmapHeader bh;
-	DibHeader dh;
-	uint16_t suffix;
-	uint32_t zero = 0;
-	const uint32_t *ptr;
+// The size fields are 32 bits. Past 4GB they are set to zero, which is
+// allowed for uncompressed images: readers go by the dimensions instead.
+static void setSizes( BitmapHeader &bh, DibHeader &dh, uint64_t offset,
+		      uint64_t pixelBytes ) {
+	bool fits = offset + pixelBytes <= UINT32_MAX;
+	dh.biSizeImage = fits ? pixelBytes : 0;
+	bh.bfSize      = fits ? offset + pixelBytes : 0;
+}
+
+// Expands n packed 24-bit pixels to 32 bits, with alpha set to 0xFF.
+static void expandRowScalar( const uint8_t *src, uint32_t *dst, uint32_t n ) {
+	for (uint32_t j = 0; j < n; ++j, src += 3)
+		dst[j] = 0xFF000000 | src[0] | (src[1] << 8) | (src[2] << 16);
+}
+
+// Packs n pixels to 24 bits, dropping alpha.
+static void packRowScalar( const uint32_t *src, uint8_t *dst, uint32_t n ) {
+	for (uint32_t j = 0; j < n; ++j, dst += 3) {
+		dst[0] = src[j];
+		dst[1] = src[j] >> 8;
+		dst[2] = src[j] >> 16;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// Same, four pixels at a time: pshufb moves each 3-byte pixel into its own
+// 32-bit lane, and the alpha byte is ORed in. Reads up to 4 bytes past
+// the last pixel, which the caller must allow for.
+__attribute__((target("ssse3")))
+static void expandRowSSSE3( const uint8_t *src, uint32_t *dst, uint32_t n ) {
+	const __m128i shuffle = _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1,
+					       6, 7, 8, -1, 9, 10, 11, -1 );
+	const __m128i alpha = _mm_set1_epi32( 0xFF000000 );
+
+	uint32_t j = 0;
+	for (; j + 4 <= n; j += 4, src += 12) {
+		__m128i v = _mm_loadu_si128( (const __m128i*) src );
+		v = _mm_or_si128( _mm_shuffle_epi8( v, shuffle ), alpha );
+		_mm_storeu_si128( (__m128i*) (dst + j), v );
+	}
+	expandRowScalar( src, dst + j, n - j );
+}
+
+// Same, four pixels at a time. Writes up to 4 bytes past the last pixel,
+// which the caller must allow for.
+__attribute__((target("ssse3")))
+static void packRowSSSE3( const uint32_t *src, uint8_t *dst, uint32_t n ) {
+	const __m128i shuffle = _mm_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9,
+					       10, 12, 13, 14, -1, -1, -1, -1 );
+
+	uint32_t j = 0;
+	for (; j + 4 <= n; j += 4, dst += 12) {
+		__m128i v = _mm_loadu_si128( (const __m128i*) (src + j) );
+		_mm_storeu_si128( (__m128i*) dst, _mm_shuffle_epi8( v, shuffle ) );
+	}
+	packRowScalar( src + j, dst, n - j );
+}
+
+static const bool ssse3 = __builtin_cpu_supports( "ssse3" );
+
+static void expandRow( const uint8_t *src, uint32_t *dst, uint32_t n ) {
+	if (ssse3)
+		expandRowSSSE3( src, dst, n );
+	else
+		expandRowScalar( src, dst, n );
+}
+
+static void packRow( const uint32_t *src, uint8_t *dst, uint32_t n ) {
+	if (ssse3)
+		packRowSSSE3( src, dst, n );
+	else
+		packRowScalar( src, dst, n );
+}
+#else
+static void expandRow( const uint8_t *src, uint32_t *dst, uint32_t n ) {
+	expandRowScalar( src, dst, n );
+}
+
+static void packRow( const uint32_t *src, uint8_t *dst, uint32_t n ) {
+	packRowScalar( src, dst, n );
+}
+#endif
 
-	ofstream output(fileName.c_str(), std::ios_base::binary);	
-	if (!output.good()) return -1;
+
+std::ostream *openOutput( const string &fileName, std::ofstream &file ) {
+	if (fileName == "-") return &std::cout;
+
+	file.open( fileName.c_str(), std::ios_base::binary );
+	return file.good() ? &file : NULL;
+}
+
+int closeOutput( std::ostream *output, std::ofstream &file ) {
+	output->flush();
+	if (file.is_open()) file.close();
+	return output->fail() ? -1 : 0;
+}
+
+// Fills in the headers of a 24-bit BMP. Returns the bytes per row, padding
+// included.
+static uint32_t header24( BitmapHeader &bh, DibHeader &dh, uint32_t width,
+			  uint32_t height, bool topDown ) {
+	uint16_t suffix;
 
 	// suffix = ((width + 3) & ~0x03) - width;
 	suffix = ( 4 - (3*width)%4 )%4;
 	
 	dh.biSize          = sizeof(DibHeader);
 	dh.biWidth         = width;
-	dh.biHeight        = height;
+	dh.biHeight        = topDown ? -(int32_t) height : height;
 	dh.biPlanes        = 1;
 	dh.biBitCount      = 24;
 	dh.biCompression   = 0;
-	// dh.biSizeImage     = (uint16_t) ( (width*3+suffix)*height );
-	dh.biSizeImage     = (width*3+suffix)*height;
 	dh.biXPelsPerMeter = 0x2E23;
 	dh.biYPelsPerMeter = dh.biXPelsPerMeter;
 	dh.biClrUsed       = 0;
 	dh.biClrImportant  = 0;
 
 	bh.bfType    = 0x4D42;
-	bh.bfSize    = dh.biSizeImage + 0x0036;
 	bh.bfRes1    = 0;
 	bh.bfOffBits = 0x0036;
-	output.write( (char*) &bh, sizeof(BitmapHeader) );
-	output.write( (char*) &dh, sizeof(DibHeader) );
+	setSizes( bh, dh, bh.bfOffBits, (uint64_t) (width*3+suffix)*height );
 
-	ptr = data + (width * height);
-	for (uint32_t i = 0; i < height; i++)
-	{
-		ptr -= width;
+	return 3*width + suffix;
+}
 
-		for (uint32_t j = 0; j < width; ++j)
-			output.write( (char*) (ptr + j), 3 );
+// Packs n rows into dst, rowBytes apart, and zeroes the padding at the end
+// of each. dst needs 4 bytes of slack at the end for the vector version.
+static void packRows( const uint32_t *src, uint8_t *dst, uint32_t width,
+		      uint32_t rowBytes, uint32_t n ) {
+	for (uint32_t k = 0; k < n; k++, src += width, dst += rowBytes) {
+		packRow( src, dst, width );
+		memset( dst + 3*width, 0, rowBytes - 3*width );
+	}
+}
+
+BitmapWriter::~BitmapWriter() {
+	delete[] buf;
+}
+
+// Writes the headers of a 24-bit BMP, and sets up a staging buffer of
+// about 1MB: rows are packed into it and written out whenever it is full,
+// rather than one pixel at a time.
+int BitmapWriter::open( const string &fileName, uint32_t width,
+			uint32_t height, bool topDown ) {
+	BitmapHeader bh;
+	DibHeader dh;
+
+	output = openOutput( fileName, file );
+	if (!output) return -1;
+
+	rowBytes = header24( bh, dh, width, height, topDown );
+	output->write( (char*) &bh, sizeof(BitmapHeader) );
+	output->write( (char*) &dh, sizeof(DibHeader) );
+
+	this->width = width;
+	capacity = std::max( 1u, (1u << 20) / rowBytes );
+	used = 0;
+	delete[] buf;
+	buf = new uint8_t[(size_t) rowBytes * capacity + 4]();
+
+	return output->good() ? 0 : -1;
+}
+
+void BitmapWriter::write( const uint32_t *rows, uint32_t n ) {
+	for (uint32_t k = 0; k < n; k++, rows += width) {
+		packRows( rows, buf + (size_t) used * rowBytes, width, rowBytes, 1 );
+
+		if (++used == capacity)
+			flush();
+	}
+}
+
+void BitmapWriter::flush() {
+	output->write( (char*) buf, (std::streamsize) rowBytes * used );
+	used = 0;
+}
 
-		if (suffix > 0)
-			output.write( (char*) &zero, suffix );
+int BitmapWriter::close() {
+	flush();
+	return closeOutput( output, file );
+}
+
+static bool pwriteAll( int fd, const uint8_t *buf, size_t n, off_t at ) {
+	while (n > 0) {
+		ssize_t k = pwrite( fd, buf, n, at );
+		if (k < 0 && errno == EINTR) continue;
+		if (k <= 0) return false;
+		buf += k; n -= k; at += k;
 	}
+	return true;
+}
 
-	output.close();
+// Writes a Windows Bitmap image (BMP3, 24 bits) data structure from raw data
+//
+// Every row has the same size, so its place in the file is known up front:
+// each thread packs a band of rows, about 1MB at a time, and writes it
+// straight to its place with pwrite(). The rows of a band are contiguous
+// in the file either way, just in reverse order for a bottom-up file.
+int saveBitmap(	const uint32_t *data, uint32_t width, uint32_t height,
+		const string &fileName, bool topDown ) {
+	BitmapHeader bh;
+	DibHeader dh;
 
-  return 0;
+	// a pipe takes the rows in order only, from one writer
+	if (fileName == "-") {
+		BitmapWriter writer;
+		if (writer.open( fileName, width, height, topDown )) return -1;
+		for (uint32_t i = 0; i < height; i++)
+			writer.write( data + (size_t) (topDown ? i : height-1-i) * width, 1 );
+		return writer.close();
+	}
+
+	uint32_t rowBytes = header24( bh, dh, width, height, topDown );
+
+	int fd = open( fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+	if (fd < 0) return -1;
+
+	uint8_t head[sizeof(BitmapHeader) + sizeof(DibHeader)];
+	memcpy( head, &bh, sizeof(BitmapHeader) );
+	memcpy( head + sizeof(BitmapHeader), &dh, sizeof(DibHeader) );
+	std::atomic<bool> ok( pwriteAll( fd, head, sizeof(head), 0 ) );
+
+	parallelBands( 0, height, [&]( int b, int e ) {
+		uint32_t chunk = std::max( 1u, (1u << 20) / rowBytes );
+		std::vector<uint8_t> buf( (size_t) rowBytes * chunk + 4 );
+
+		// bottom up, the chunks go from the end of the band, so that
+		// each one is a contiguous range of rows in the file
+		for (uint32_t done = 0; done < (uint32_t) (e - b) && ok; ) {
+			uint32_t n = std::min( chunk, (uint32_t) (e - b) - done );
+			uint32_t first = topDown ? b + done : e - done - n;
+			uint32_t fileRow = topDown ? first : height - first - n;
+
+			if (topDown) {
+				packRows( data + (size_t) first * width, &buf[0],
+					  width, rowBytes, n );
+			} else {
+				for (uint32_t k = 0; k < n; k++)
+					packRows( data + (size_t) (first+n-1-k) * width,
+						  &buf[ (size_t) k * rowBytes ],
+						  width, rowBytes, 1 );
+			}
+			if (!pwriteAll( fd, &buf[0], (size_t) rowBytes * n,
+					sizeof(head) + (off_t) fileRow * rowBytes ))
+				ok = false;
+			done += n;
+		}
+	} );
+
+	return close( fd ) == 0 && ok ? 0 : -1;
 }
 
-// Allocates memory for and loads an Windows Bitmap image (BMP3, 24 bits)
-int loadBitmap(	const string &fileName, uint32_t *&data,
-		uint16_t &width, uint16_t &height ) {
+// Images that live in a file mapping rather than on the heap, with the
+// start and length of the mapping.
+static std::map<const uint32_t*, std::pair<void*, size_t> > mappings;
+
+// The contents of an input file: memory-mapped where the system allows,
+// otherwise (pipes, say) read into a buffer. The mapping is private but
+// writable, so that it can be handed out as an image in its own right.
+struct FileView {
+	const uint8_t *data;
+	size_t size;
+	bool mapped;
+};
+
+static int openView( const string &fileName, FileView &view ) {
+	view.data = NULL;
+	view.size = 0;
+	view.mapped = false;
+
+	int fd = open( fileName.c_str(), O_RDONLY );
+	if (fd < 0) return -1;
+
+	struct stat st;
+	if (fstat( fd, &st ) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *p = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE, fd, 0 );
+		if (p != MAP_FAILED) {
+			madvise( p, st.st_size, MADV_SEQUENTIAL );
+			view.data = (const uint8_t*) p;
+			view.size = st.st_size;
+			view.mapped = true;
+			close( fd );
+			return 0;
+		}
+	}
+
+	std::vector<uint8_t> buf;
+	uint8_t chunk[1 << 16];
+	ssize_t n;
+	while ((n = read( fd, chunk, sizeof(chunk) )) > 0)
+		buf.insert( buf.end(), chunk, chunk + n );
+	close( fd );
+	if (n < 0) return -1;
+
+	uint8_t *copy = new uint8_t[buf.size() + 1];
+	std::copy( buf.begin(), buf.end(), copy );
+	view.data = copy;
+	view.size = buf.size();
+	return 0;
+}
+
+static void closeView( FileView &view ) {
+	if (view.mapped)
+		munmap( (void*) view.data, view.size );
+	else
+		delete[] view.data;
+	view.data = NULL;
+}
+
+// Layout of the pixel array, as described by the headers.
+struct PixelFormat {
+	size_t offset;		// of the pixel array in the file
+	uint16_t bits;		// 1, 4, 8, 24 or 32
+	bool topDown;
+	uint32_t mask[4];	// 32 bits: red, green, blue, alpha; alpha may be 0
+	uint32_t palette[256];	// 1 to 8 bits
+	int colors;
+};
+
+// Bytes per row, including the padding to a multiple of 4.
+static size_t rowBytes( const PixelFormat &fmt, uint32_t width ) {
+	return ((size_t) fmt.bits * width + 31) / 32 * 4;
+}
+
+// Palette index of pixel x in a row of 1, 4, or 8 bits per pixel.
+static inline uint8_t rowIndex( const uint8_t *row, uint32_t x, int bits ) {
+	if (bits == 8) return row[x];
+	if (bits == 4) return (row[x >> 1] >> (x & 1 ? 0 : 4)) & 0x0F;
+	return (row[x >> 3] >> (7 - (x & 7))) & 0x01;
+}
+
+static bool isByteMask( uint32_t m ) {
+	return m == 0xFF || m == 0xFF00 || m == 0xFF0000 || m == 0xFF000000;
+}
+
+static int maskShift( uint32_t m ) {
+	int s = 0;
+	while (m > 0xFF) { m >>= 8; s += 8; }
+	return s;
+}
+
+// Checks the headers of a BMP file and works out the pixel layout. Takes
+// all header versions (BITMAPINFOHEADER to BITMAPV5HEADER); uncompressed
+// palettized images of 1, 4, or 8 bits; 24 bits; and 32 bits, either
+// uncompressed (the fourth byte is unused) or with BI_BITFIELDS masks, as
+// long as every channel is one byte.
+static int readHeaders( const FileView &view, uint32_t &width,
+			uint32_t &height, PixelFormat &fmt ) {
 	BitmapHeader bh;
 	DibHeader dh;
-	uint16_t suffix;
-	uint32_t zero = 0;
-	uint32_t *ptr;
-	uint16_t bits;
 
-	ifstream input(fileName.c_str(), std::ios_base::binary);
-	if (!input.good()) return -1;
+	if (view.size < sizeof(BitmapHeader) + sizeof(DibHeader)) return -1;
 
-	input.read( (char*) &bh, sizeof(BitmapHeader) );
+	memcpy( &bh, view.data, sizeof(BitmapHeader) );
 	if (bh.bfType != 0x4D42) return -1;
-	input.read( (char*) &dh.biSize, sizeof(uint32_t) );
-	if (dh.biSize != 40) return -2;
+	memcpy( &dh, view.data + sizeof(BitmapHeader), sizeof(DibHeader) );
+	if (dh.biSize != 40 && dh.biSize != 52 && dh.biSize != 56 &&
+	    dh.biSize != 108 && dh.biSize != 124) return -2;
+
+	int64_t h = dh.biHeight < 0 ? -(int64_t) dh.biHeight : dh.biHeight;
+	if (dh.biWidth <= 0 || h == 0 || h > INT32_MAX)
+		return -2;
 
-	input.read( (char*) &dh.biWidth, sizeof(DibHeader) - sizeof(uint32_t) );
 	width  = dh.biWidth;
-	height = dh.biHeight;
-	if (dh.biBitCount != 24) return -3;
+	height = h;
+	fmt.offset = bh.bfOffBits;
+	fmt.bits = dh.biBitCount;
+	fmt.topDown = dh.biHeight < 0;
+
+	if (fmt.bits == 24)
+		return dh.biCompression == 0 ? 0 : -5;
+
+	// the palette follows the headers, 4 bytes per color (BGR and an
+	// unused byte); missing colors are black
+	if (fmt.bits == 1 || fmt.bits == 4 || fmt.bits == 8) {
+		if (dh.biCompression != 0) return -5;
+
+		int max = 1 << fmt.bits;
+		fmt.colors = dh.biClrUsed > 0 && dh.biClrUsed < (uint32_t) max ?
+			dh.biClrUsed : max;
+
+		size_t at = sizeof(BitmapHeader) + dh.biSize;
+		if (view.size < at + 4*fmt.colors) return -1;
+
+		for (int c = 0; c < 256; c++)
+			fmt.palette[c] = 0xFF000000;
+		for (int c = 0; c < fmt.colors; c++) {
+			memcpy( &fmt.palette[c], view.data + at + 4*c, 4 );
+			fmt.palette[c] |= 0xFF000000;
+		}
+		return 0;
+	}
+	if (fmt.bits != 32) return -3;
+
+	fmt.mask[0] = 0xFF0000;
+	fmt.mask[1] = 0xFF00;
+	fmt.mask[2] = 0xFF;
+	fmt.mask[3] = 0;
+
+	// BI_BITFIELDS or BI_ALPHABITFIELDS: the masks are part of the
+	// newer headers, and follow the original one
+	if (dh.biCompression == 3 || dh.biCompression == 6) {
+		int n = dh.biSize >= 56 || dh.biCompression == 6 ? 4 : 3;
+		size_t at = sizeof(BitmapHeader) + 40;
+		if (view.size < at + 4*n) return -1;
+
+		memcpy( fmt.mask, view.data + at, 4*n );
+		for (int c = 0; c < 4; c++)
+			if (!isByteMask( fmt.mask[c] ) && !(c == 3 && !fmt.mask[c]))
+				return -5;
+	} else if (dh.biCompression != 0) {
+		return -5;
+	}
+	return 0;
+}
 
-	// suffix = ((width + 3) & ~0x03) - width;
-	suffix = ( 4 - (3*width)%4 )%4;
-	ptr = data = new uint32_t[width * height]();
-	ptr += width * height;
-	for (uint32_t i = 0; i < height; i++)
-	{
-		ptr -= width;
+// Converts n 32-bit pixels with the given channel masks to the internal
+// layout (which is that of a little-endian BGRA BMP).
+static void convertRow( const uint8_t *src, uint32_t *dst, uint32_t n,
+			const uint32_t *mask ) {
+	if (mask[0] == 0xFF0000 && mask[1] == 0xFF00 && mask[2] == 0xFF) {
+		memcpy( dst, src, 4*(size_t) n );
+		if (mask[3] != 0xFF000000)
+			for (uint32_t j = 0; j < n; ++j)
+				dst[j] |= 0xFF000000;
+		return;
+	}
+
+	int r = maskShift( mask[0] ), g = maskShift( mask[1] );
+	int b = maskShift( mask[2] ), a = maskShift( mask[3] );
+	for (uint32_t j = 0; j < n; ++j, src += 4) {
+		uint32_t v;
+		memcpy( &v, src, 4 );
+		dst[j] = ((v >> r) & 0xFF) << 16 | ((v >> g) & 0xFF) << 8 |
+			 ((v >> b) & 0xFF) |
+			 (mask[3] ? ((v >> a) & 0xFF) << 24 : 0xFF000000);
+	}
+}
 
+// True if the file holds the whole pixel array. Some writers leave off the
+// padding of the last row. Checked before anything is allocated, so that
+// the dimensions in a damaged header cannot ask for more memory than the
+// file could possibly fill.
+static bool pixelsPresent( const FileView &view, const PixelFormat &fmt,
+			   uint32_t width, uint32_t height ) {
+	return fmt.offset <= view.size && view.size - fmt.offset >=
+		rowBytes( fmt, width ) * (height-1) +
+		((size_t) fmt.bits * width + 7) / 8;
+}
+
+// Converts one row of the pixel array to 32 bits. The vector version reads
+// a few bytes past the row, and is only used if "slack" says they exist.
+static void decodeRow( const PixelFormat &fmt, const uint8_t *src,
+		       uint32_t *dst, uint32_t width, bool slack ) {
+	if (fmt.bits <= 8)
 		for (uint32_t j = 0; j < width; ++j)
-		{
-			input.read( (char*) (ptr + j), 3 );
-			*(ptr + j) |= 0xFF000000;
+			dst[j] = fmt.palette[ rowIndex( src, j, fmt.bits ) ];
+	else if (fmt.bits == 32)
+		convertRow( src, dst, width, fmt.mask );
+	else if (slack)
+		expandRow( src, dst, width );
+	else
+		expandRowScalar( src, dst, width );
+}
+
+// Converts the pixel array, straight from the file contents, to 32 bits;
+// image row i goes to data + i*stride.
+static int readPixels( const FileView &view, const PixelFormat &fmt,
+		       uint32_t *data, uint32_t width, uint32_t height,
+		       size_t stride ) {
+	size_t bytes = rowBytes( fmt, width );
+	size_t offset = fmt.offset;
+
+	if (!pixelsPresent( view, fmt, width, height )) return -4;
+
+	// rows are independent, and a band of them goes to each thread; the
+	// threads fault in their own part of the mapping as they go
+	const uint8_t *pix = view.data + offset;
+	parallelBands( 0, height, [&]( int b, int e ) {
+		for (uint32_t i = b; i < (uint32_t) e; i++) {
+			size_t r = (size_t) (fmt.topDown ? i : height-1-i) * bytes;
+			decodeRow( fmt, pix + r, data + (size_t) i * stride, width,
+				   offset + r + 3*width + 4 <= view.size );
 		}
+	} );
+	return 0;
+}
+
+// Copies one row of a palettized pixel array as indices, one per byte.
+static void indexRow( const PixelFormat &fmt, const uint8_t *src,
+		      uint8_t *dst, uint32_t width ) {
+	if (fmt.bits == 8)
+		memcpy( dst, src, width );
+	else
+		for (uint32_t j = 0; j < width; ++j)
+			dst[j] = rowIndex( src, j, fmt.bits );
+}
+
+// Where loadIndexedBitmap() keeps a palettized image; NULL for the plain
+// loaders, which expand it.
+struct IndexTarget {
+	uint8_t **index;
+	uint32_t *palette;
+	int *colors;
+};
+
+// Reads a BMP from a pipe, which can only be read once, front to back: the
+// headers first, then the rows, straight into the image one at a time.
+// For a bottom-up file, that means from the last image row up.
+static int loadBitmapStream( FILE *in, uint32_t *&data, uint32_t &width,
+			     uint32_t &height, int pad, IndexTarget *ix ) {
+	BitmapHeader bh;
+	PixelFormat fmt;
 
-		if (suffix > 0)
-			input.read( (char*) &zero, suffix );
+	// everything up to the pixel array: headers, masks, palette
+	if (fread( &bh, sizeof(BitmapHeader), 1, in ) != 1) return -1;
+	if (bh.bfType != 0x4D42) return -1;
+	if (bh.bfOffBits < sizeof(BitmapHeader) + sizeof(DibHeader) ||
+	    bh.bfOffBits > (1 << 20)) return -2;
+
+	std::vector<uint8_t> head( bh.bfOffBits );
+	memcpy( &head[0], &bh, sizeof(BitmapHeader) );
+	if (fread( &head[sizeof(BitmapHeader)], head.size() -
+		   sizeof(BitmapHeader), 1, in ) != 1) return -4;
+
+	FileView view = { &head[0], head.size(), false };
+	if (int res = readHeaders( view, width, height, fmt )) return res;
+	if (width > (uint32_t) (INT32_MAX - 2*pad) ||
+	    height > (uint32_t) (INT32_MAX - 2*pad)) return -2;
+
+	size_t fullWidth = width + 2*pad;
+	size_t fullSize = fullWidth*(height + 2*pad);
+	uint8_t *plane = NULL;
+	if (ix && fmt.bits <= 8) {
+		plane = new (std::nothrow) uint8_t[fullSize]();
+		if (!plane) return -1;
+	} else {
+		data = new (std::nothrow) uint32_t[fullSize]();
+		if (!data) return -1;
+	}
+
+	// the last row may come without its padding
+	size_t bytes = rowBytes( fmt, width );
+	std::vector<uint8_t> row( bytes + 4 );
+	for (uint32_t i = 0; i < height; i++) {
+		size_t n = i+1 < height ? bytes :
+			((size_t) fmt.bits * width + 7) / 8;
+		if (fread( &row[0], 1, n, in ) != n) {
+			delete[] data;
+			delete[] plane;
+			data = NULL;
+			return -4;
+		}
+
+		uint32_t y = fmt.topDown ? i : height-1-i;
+		if (plane)
+			indexRow( fmt, &row[0], plane + (pad+y)*fullWidth + pad,
+				  width );
+		else
+			decodeRow( fmt, &row[0], data + (pad+y)*fullWidth + pad,
+				   width, true );
 	}
 
-	input.close();
+	if (plane) {
+		fillPadding( plane, width, height, pad );
+		*ix->index = plane;
+		memcpy( ix->palette, fmt.palette, sizeof(fmt.palette) );
+		*ix->colors = fmt.colors;
+	} else {
+		fillPadding( data, width, height, pad );
+	}
 	return 0;
 }
 
+// Allocates memory for and loads an Windows Bitmap image (BMP3, 24 bits)
+int loadBitmap(	const string &fileName, uint32_t *&data,
+		uint32_t &width, uint32_t &height ) {
+	return loadBitmapPadded( fileName, data, width, height, 0 );
+}
+
 // Like loadBitmap(), but allocates "pad" pixels on all four sides, and fills
 // them with the nearest pixel values. This greatly simplifies edge handling
 // in the scaling algos. The only place to add the padding is when the data
 // structure is first created and populated. True width and height are
 // width+2*pad, height+2*pad. This is not separately reported, client code
 // is responsible for providing to algos a data struct w/ required padding.
-int loadBitmapPadded( const string &fileName, uint32_t *&data,
-		      uint16_t &width, uint16_t &height, uint16_t pad ) {
-	BitmapHeader bh;
-	DibHeader dh;
-	uint16_t suffix;
-	uint32_t zero = 0;
-	uint32_t *ptr;
-	uint16_t bits;
+//
+// A 32-bit top-down BGRA file that needs no padding already is the image:
+// then the mapping of the file is returned as is, without any copy.
+static int loadPadded( const string &fileName, uint32_t *&data,
+		       uint32_t &width, uint32_t &height, int pad,
+		       IndexTarget *ix ) {
+	size_t fullWidth, fullHeight;
+	FileView view;
+	PixelFormat fmt;
+
+	if (fileName == "-")
+		return loadBitmapStream( stdin, data, width, height, pad, ix );
+	if (openView( fileName, view )) return -1;
+	int res = readHeaders( view, width, height, fmt );
+
+	// the scalers index rows with int, padding included
+	if (res == 0 && (width > (uint32_t) (INT32_MAX - 2*pad) ||
+			 height > (uint32_t) (INT32_MAX - 2*pad)))
+		res = -2;
+	if (res == 0 && !pixelsPresent( view, fmt, width, height ))
+		res = -4;
+	if (res) {
+		closeView( view );
+		return res;
+	}
 
-	uint16_t fullWidth, fullHeight, origin;
-	
-	ifstream input(fileName.c_str(), std::ios_base::binary);
-	if (!input.good()) return -1;
+	fullWidth = width + 2*pad;
+	fullHeight = height + 2*pad;
 
-	input.read( (char*) &bh, sizeof(BitmapHeader) );
-	if (bh.bfType != 0x4D42) return -1;
-	input.read( (char*) &dh.biSize, sizeof(uint32_t) );
-	if (dh.biSize != 40) return -2;
+	if (ix && fmt.bits <= 8) {
+		uint8_t *plane = new (std::nothrow) uint8_t[fullWidth*fullHeight]();
+		if (!plane) {
+			closeView( view );
+			return -1;
+		}
+		size_t bytes = rowBytes( fmt, width );
+		for (uint32_t i = 0; i < height; i++)
+			indexRow( fmt, view.data + fmt.offset +
+				  (size_t) (fmt.topDown ? i : height-1-i) * bytes,
+				  plane + (pad+i)*fullWidth + pad, width );
+		closeView( view );
+
+		fillPadding( plane, width, height, pad );
+		*ix->index = plane;
+		memcpy( ix->palette, fmt.palette, sizeof(fmt.palette) );
+		*ix->colors = fmt.colors;
+		return 0;
+	}
 
-	input.read( (char*) &dh.biWidth, sizeof(DibHeader) - sizeof(uint32_t) );
-	width  = dh.biWidth;
-	height = dh.biHeight;
-	if (dh.biBitCount != 24) return -3;
+	if (pad == 0 && view.mapped && fmt.bits == 32 && fmt.topDown &&
+	    fmt.offset % 4 == 0 && fmt.mask[0] == 0xFF0000 &&
+	    fmt.mask[1] == 0xFF00 && fmt.mask[2] == 0xFF &&
+	    fmt.mask[3] == 0xFF000000 && fmt.offset <= view.size &&
+	    view.size - fmt.offset >= 4*(size_t) width*height) {
+		data = (uint32_t*) (view.data + fmt.offset);
+		mappings[data] = std::make_pair( (void*) view.data, view.size );
+		return 0;
+	}
 
-//	suffix = ((width + 3) & ~0x03) - width;      // orig
-//	suffix = ((3*width + 3) & ~0x03) - 3*width;  // corrected
-	suffix = ( 4 - (3*width)%4 )%4;              // pkj
+	data = new (std::nothrow) uint32_t[fullWidth*fullHeight]();
+	if (!data) {
+		closeView( view );
+		return -1;
+	}
+	res = readPixels( view, fmt, data + pad*fullWidth + pad,
+			      width, height, fullWidth );
+	closeView( view );
+	if (res) {
+		delete[] data;
+		data = NULL;
+		return res;
+	}
 
-	fullWidth = width + 2*pad;
-	fullHeight = height + 2*pad;
-	
-	ptr = data = new uint32_t[fullWidth*fullHeight]();
-	ptr += pad + (pad+height)*fullWidth;
-	
-	for (uint32_t i = 0; i < height; i++) {
-  	        ptr -= fullWidth;
+	fillPadding( data, width, height, pad );
+	return 0;
+}
 
-		for (uint32_t j = 0; j < width; ++j) {
-			input.read( (char*) (ptr + j), 3 );
-			*(ptr + j) |= 0xFF000000;
-		}
+int loadBitmapPadded( const string &fileName, uint32_t *&data,
+		      uint32_t &width, uint32_t &height, int pad ) {
+	return loadPadded( fileName, data, width, height, pad, NULL );
+}
 
-		if (suffix > 0) {
-			input.read( (char*) &zero, suffix );
-		}
+int loadIndexedBitmap( const string &fileName, uint32_t *&data,
+		       uint8_t *&index, uint32_t *palette, int &colors,
+		       uint32_t &width, uint32_t &height, int pad ) {
+	IndexTarget ix = { &index, palette, &colors };
+	data = NULL;
+	index = NULL;
+	colors = 0;
+	int res = loadPadded( fileName, data, width, height, pad, &ix );
+
+	// indices past the end of the palette are black, as when expanded
+	if (res == 0 && index) {
+		size_t n = (size_t) (width + 2*pad) * (height + 2*pad);
+		for (size_t i = 0; i < n; i++)
+			colors = std::max( colors, index[i] + 1 );
 	}
-	input.close();
+	return res;
+}
+
+// Padding is filled from the nearest image pixel: the edge rows and columns
+// are repeated outward, and the corners take the corner pixels.
+template<typename T>
+static void fillPaddingT( T *data, uint32_t width, uint32_t height, int pad ) {
+	size_t fullWidth = width + 2*pad, origin;
 
 	// Top and bottom padding
-	for( int i=0; i<width; i++ ) {
+	for( size_t i=0; i<width; i++ ) {
 	  for( int j=0; j<pad; j++ ) {
 	    data[j*fullWidth + pad + i] = data[pad*fullWidth + pad + i];
 	    data[(pad+height+j)*fullWidth + pad + i] =
@@ -216,7 +773,7 @@ int loadBitmapPadded( const string &fileName, uint32_t *&data,
 	}
 
 	// Left and right padding
-	for( int i=0; i<height; i++ ) {
+	for( size_t i=0; i<height; i++ ) {
 	  for( int j=0; j<pad; j++ ) {
 	    data[(pad+i)*fullWidth + j] = data[(pad+i)*fullWidth + pad];
 	    data[(pad+i)*fullWidth + pad + width + j] =
@@ -241,6 +798,176 @@ int loadBitmapPadded( const string &fileName, uint32_t *&data,
 	      data[(pad+height-1)*fullWidth + pad + width];
 	  }
 	}
+}
+
+void fillPadding( uint32_t *data, uint32_t width, uint32_t height, int pad ) {
+	fillPaddingT( data, width, height, pad );
+}
+
+void fillPadding( uint8_t *data, uint32_t width, uint32_t height, int pad ) {
+	fillPaddingT( data, width, height, pad );
+}
 
+uint32_t *expandIndexed( const uint8_t *index, const uint32_t *palette,
+			 size_t n ) {
+	uint32_t *data = new (std::nothrow) uint32_t[n];
+	if (!data) return NULL;
+	for (size_t i = 0; i < n; i++)
+		data[i] = palette[index[i]];
+	return data;
+}
+
+int indexBitmap( const uint32_t *data, long n, uint8_t *index,
+		 uint32_t *palette, int &colors ) {
+	std::unordered_map<uint32_t, uint8_t> lookup;
+	for (int c = colors - 1; c >= 0; c--)
+		lookup[palette[c] | 0xFF000000] = c;
+
+	// runs of the same color are common, and skip the lookup
+	uint32_t last = 0;
+	uint8_t lastIndex = 0;
+	for (long i = 0; i < n; i++) {
+		uint32_t v = data[i] | 0xFF000000;
+		if (i > 0 && v == last) {
+			index[i] = lastIndex;
+			continue;
+		}
+
+		std::unordered_map<uint32_t, uint8_t>::iterator it = lookup.find( v );
+		if (it == lookup.end()) {
+			if (colors == 256) return -1;
+			palette[colors] = v;
+			it = lookup.insert( std::make_pair( v, colors++ ) ).first;
+		}
+		index[i] = lastIndex = it->second;
+		last = v;
+	}
 	return 0;
 }
+
+int saveIndexedBitmap( const uint8_t *index, const uint32_t *palette,
+		       int colors, uint32_t width, uint32_t height,
+		       const string &fileName, bool topDown ) {
+	BitmapHeader bh;
+	DibHeader dh;
+
+	std::ofstream file;
+	std::ostream *output = openOutput( fileName, file );
+	if (!output) return -1;
+
+	uint32_t rowBytes = (width + 3) & ~3;
+	uint32_t offset = sizeof(BitmapHeader) + sizeof(DibHeader) + 4*colors;
+
+	dh.biSize          = sizeof(DibHeader);
+	dh.biWidth         = width;
+	dh.biHeight        = topDown ? -(int32_t) height : height;
+	dh.biPlanes        = 1;
+	dh.biBitCount      = 8;
+	dh.biCompression   = 0;
+	dh.biXPelsPerMeter = 0x2E23;
+	dh.biYPelsPerMeter = dh.biXPelsPerMeter;
+	dh.biClrUsed       = colors;
+	dh.biClrImportant  = 0;
+
+	bh.bfType    = 0x4D42;
+	bh.bfRes1    = 0;
+	bh.bfOffBits = offset;
+	setSizes( bh, dh, offset, (uint64_t) rowBytes*height );
+	output->write( (char*) &bh, sizeof(BitmapHeader) );
+	output->write( (char*) &dh, sizeof(DibHeader) );
+
+	for (int c = 0; c < colors; c++) {
+		uint32_t v = palette[c] & 0x00FFFFFF;
+		output->write( (char*) &v, 4 );
+	}
+
+	// the whole pixel array is a quarter of the 32-bit image; one write
+	std::vector<uint8_t> buf( (size_t) rowBytes * height, 0 );
+	for (uint32_t i = 0; i < height; i++)
+		memcpy( &buf[ (size_t) (topDown ? i : height-1-i) * rowBytes ],
+			index + (size_t) i * width, width );
+	output->write( (char*) &buf[0], buf.size() );
+
+	return closeOutput( output, file );
+}
+
+// Creates the file and maps it, so that the scaler can write its output
+// straight into the file. The pixel array starts at a 16-byte boundary.
+uint32_t *mapBitmap( const string &fileName, uint32_t width, uint32_t height,
+		     BitmapHeaderVersion version ) {
+	static const uint32_t dibSize[] = { 40, 108, 124, 0 };
+	bool raw = version == BMP_NONE;
+
+	size_t offset = raw ? 0 : (sizeof(BitmapHeader) + dibSize[version] + 15) & ~15;
+	size_t size = offset + (size_t) width * height * 4;
+
+	int fd = open( fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666 );
+	if (fd < 0) return NULL;
+
+	if (ftruncate( fd, size ) != 0) {
+		close( fd );
+		return NULL;
+	}
+	void *p = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if (p == MAP_FAILED) return NULL;
+
+	if (!raw) {
+		BitmapHeader bh;
+		DibHeader dh;
+
+		dh.biSize          = dibSize[version];
+		dh.biWidth         = width;
+		dh.biHeight        = -(int32_t) height;	// top down
+		dh.biPlanes        = 1;
+		dh.biBitCount      = 32;
+		dh.biCompression   = version == BMP_INFO ? 0 : 3;	// BI_BITFIELDS
+		dh.biXPelsPerMeter = 0x2E23;
+		dh.biYPelsPerMeter = dh.biXPelsPerMeter;
+		dh.biClrUsed       = 0;
+		dh.biClrImportant  = 0;
+
+		bh.bfType    = 0x4D42;
+		bh.bfRes1    = 0;
+		bh.bfOffBits = offset;
+		setSizes( bh, dh, offset, size - offset );
+
+		memcpy( p, &bh, sizeof(BitmapHeader) );
+		memcpy( (uint8_t*) p + sizeof(BitmapHeader), &dh, sizeof(DibHeader) );
+
+		// V4 and V5 add the channel masks, including alpha, and the
+		// color space; the rest (end points, gamma, profile) stays 0
+		if (version != BMP_INFO) {
+			uint32_t v4[5] = { 0xFF0000, 0xFF00, 0xFF, 0xFF000000,
+					   0x73524742 };	// LCS_sRGB
+			memcpy( (uint8_t*) p + sizeof(BitmapHeader) + 40, v4, sizeof(v4) );
+		}
+		if (version == BMP_V5) {
+			uint32_t intent = 4;	// LCS_GM_IMAGES
+			memcpy( (uint8_t*) p + sizeof(BitmapHeader) + 108, &intent, 4 );
+		}
+	}
+
+	uint32_t *data = (uint32_t*) ((uint8_t*) p + offset);
+	mappings[data] = std::make_pair( p, size );
+	return data;
+}
+
+void releaseBitmap( uint32_t *data ) {
+	std::map<const uint32_t*, std::pair<void*, size_t> >::iterator it =
+		mappings.find( data );
+
+	if (it == mappings.end()) {
+		delete[] data;
+		return;
+	}
+	munmap( it->second.first, it->second.second );
+	mappings.erase( it );
+}
+
+bool isOpaque( const uint32_t *data, long n ) {
+	uint32_t all = 0xFF000000;
+	for (long i = 0; i < n; ++i)
+		all &= data[i];
+	return all == 0xFF000000;
+}
@@ -19,9 +19,12 @@
 
 #include "hqx.h"
 #include "hqx1.h"
+#include "bitmap.h"
 
 // Public wrapper functions at end of source file!
 
+// PKJ: opaque selects the variants that skip the alpha channel.
+template<bool opaque>
 uint32_t *hq3x_resize(
 	char mode,
 	const uint32_t *image,
@@ -37,14 +40,14 @@ uint32_t *hq3x_resize(
 {
         bool (*isDifferent)( uint32_t color1, uint32_t color2,
 			     uint32_t trY, uint32_t trU,
-			     uint32_t trV, uint32_t trA ) = &isDifferentA;
+			     uint32_t trV, uint32_t trA ) = &isDifferentA<opaque>;
 	if( mode == 'B' ) {
-	  isDifferent = &isDifferentB;
+	  isDifferent = &isDifferentB<opaque>;
 	}	
 
-	int lineSize = width * 3;
+	long lineSize = (long)width * 3;
 
-	int previous, next;
+	long previous, next;
 	uint32_t w[9];
 
 	trY <<= 16;
@@ -71,11 +74,11 @@ uint32_t *hq3x_resize(
 
 		// adjusts the previous and next line pointers
 		if (row > 0)
-			previous = -width;
+			previous = -(long)width;
 		else
 		{
 			if (wrapY)
-				previous = width * (height - 1);
+				previous = (long)width * (height - 1);
 			else
 				previous = 0;
 		}
@@ -84,7 +87,7 @@ uint32_t *hq3x_resize(
 		else
 		{
 			if (wrapY)
-				next = -(width * (height - 1));
+				next = -((long)width * (height - 1));
 			else
 				next = 0;
 		}
@@ -3461,9 +3464,17 @@ uint32_t *hq3x_resize(
 // as default values in the original impl.
 
 void hq3xA( uint32_t *img, int w, int h, uint32_t *out ) {
-  hq3x_resize( 'A', img, w, h, out, 0x30, 0x07, 0x06, 0x50, false, false );
+  if( isOpaque( img, (long)w*h ) ) {
+    hq3x_resize<true>( 'A', img, w, h, out, 0x30, 0x07, 0x06, 0x50, false, false );
+  } else {
+    hq3x_resize<false>( 'A', img, w, h, out, 0x30, 0x07, 0x06, 0x50, false, false );
+  }
 }
 
 void hq3xB( uint32_t *img, int w, int h, uint32_t *out ) {
-  hq3x_resize( 'B', img, w, h, out, 0x30, 0x07, 0x06, 0x50, false, false );
+  if( isOpaque( img, (long)w*h ) ) {
+    hq3x_resize<true>( 'B', img, w, h, out, 0x30, 0x07, 0x06, 0x50, false, false );
+  } else {
+    hq3x_resize<false>( 'B', img, w, h, out, 0x30, 0x07, 0x06, 0x50, false, false );
+  }
 }
@@ -19,6 +19,7 @@
 
 #include <cstdlib>
 #include "hqx.h"
+#include "hqx1.h"
 
 static const uint32_t AMASK = 0xFF000000;
 static const uint32_t YMASK = 0x00FF0000;
@@ -46,7 +47,9 @@ uint32_t ARGBtoAYUV( uint32_t value )
 
 /*
  * Use this function for sharper images (good for cartoon style, used by DOSBOX)
+ * PKJ: With opaque set, the alpha channel is known to be equal and ignored.
  */
+template<bool opaque>
 bool isDifferentA(
 	uint32_t color1,
 	uint32_t color2,
@@ -69,8 +72,10 @@ bool isDifferentA(
 	value = abs(int(color1 & VMASK) - int(color2 & VMASK));
 	if (value > trV) return true;
 
-	value = abs(int(color1 & AMASK) - int(color2 & AMASK));
-	if (value > trA) return true;
+	if (!opaque) {
+		value = abs(int(color1 & AMASK) - int(color2 & AMASK));
+		if (value > trA) return true;
+	}
 
 	return false;
 }
@@ -78,6 +83,7 @@ bool isDifferentA(
 /*
  * Use this function for smoothed images (good for complex graphics)
  */
+template<bool opaque>
 bool isDifferentB(
 	uint32_t color1,
 	uint32_t color2,
@@ -92,5 +98,10 @@ bool isDifferentB(
 	return abs(int(yuv1 & YMASK) - int(yuv2 & YMASK)) > trY ||
 		   abs(int(yuv1 & UMASK) - int(yuv2 & UMASK)) > trU ||
 		   abs(int(yuv1 & VMASK) - int(yuv2 & VMASK)) > trV ||
-		   abs(int(yuv1 & AMASK) - int(yuv2 & AMASK)) > trA;
+		   (!opaque && abs(int(yuv1 & AMASK) - int(yuv2 & AMASK)) > trA);
 }
+
+template bool isDifferentA<false>( uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t );
+template bool isDifferentA<true>( uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t );
+template bool isDifferentB<false>( uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t );
+template bool isDifferentB<true>( uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t );
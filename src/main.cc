@@ -26,14 +26,28 @@ SOFTWARE.
 */		  
 		  
 #include <iostream>
+#include <cstdio>
 #include <cstdlib>
 #include <cstdint>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <new>
 
 #include "bitmap.h"
+#include "pnm.h"
+#include "qoi.h"
 #include "scalenx.h"
+#include "sai.h"
 #include "xbr.h"
+#ifdef WITH_XBRZ
+#include "xbrz.h"
+#endif
 #include "hqx.h"
+#include "parallel.h"
+#include "resample.h"
+#include "rotsprite.h"
 
 using std::string;
 
@@ -41,12 +55,190 @@ void print_usage(int err) {
   if( err > 0) {
     std::cerr << "Unknown algorithm" << std::endl << "" << std::endl;
   }
-  std::cerr << "Usage: pixelscaler algo infile [outfile]" << std::endl;
-  std::cerr << "Algos: copy block2 block3 scale2x scale2xSFX scale3x scale3xSFX hq2xA hq2xB hq3xA hq3xB superXBR" << std::endl;
-  std::cerr << "File format: Microsoft Bitmap BMP3 24bits per pixel"<<std::endl;
+  std::cerr << "Usage: pixelscaler [options] algo infile [outfile]" << std::endl;
+  std::cerr << "Algos: copy block2 block3 scale2x scale2xSFX mmpx 2xSaI super2xSaI superEagle scale3x scale3xSFX hq2xA hq2xB hq3xA hq3xB superXBR superXBR4x superXBR8x xbr2x xbr3x xbr4x"
+#ifdef WITH_XBRZ
+	    << " xbrz2x xbrz3x xbrz4x xbrz5x xbrz6x"
+#endif
+	    << " rotsprite" << std::endl;
+  std::cerr << "       superXBR* take a preset suffix :fast (2 passes) or :full (default)" << std::endl;
+  std::cerr << "       xbr2x, xbr3x, xbr4x take a preset suffix :lv2 (default) or :lv3" << std::endl;
+  std::cerr << "Options: --threads N   worker threads (default: one per core)" << std::endl;
+  std::cerr << "         --memo        cache repeated superXBR windows, report hit rates" << std::endl;
+  std::cerr << "         --bits N      bits per pixel of the output BMP, 24 (default), 32, or 8 (palettized)" << std::endl;
+  std::cerr << "         --top-down    write 24-bit output top down, streaming rows" << std::endl;
+  std::cerr << "         --header V    header of 32-bit output: v5 (default), v4, or info (no alpha)" << std::endl;
+  std::cerr << "         --angle DEG   rotation for rotsprite, counterclockwise" << std::endl;
+  std::cerr << "         --size WxH    resample the scaled image to W x H pixels" << std::endl;
+  std::cerr << "         --resample F  filter for --size: area (default) or bilinear" << std::endl;
+  std::cerr << "         --format F    output format: bmp, ppm, pam, or qoi (default: by extension)" << std::endl;
+  std::cerr << "File format: Microsoft Bitmap, 1, 4, 8, 24 or 32 bits per pixel"<<std::endl;
+  std::cerr << "             netpbm PPM (P6) and PAM (P7), 8 bits per sample"<<std::endl;
+  std::cerr << "             QOI, RGB or RGBA"<<std::endl;
+  std::cerr << "             outfile *.raw: bare 32-bit BGRA pixels, no header"<<std::endl;
+  std::cerr << "             infile or outfile -: standard input or output"<<std::endl;
 }
 
-// Takes 2 or 3 arguments: algo infile outfile
+// Runs the scaler named algo on a w x h image, as loaded with the padding
+// the scaler needs, and writes the scaled image to output.
+static void runScaler( const string &algo, uint32_t *image, int width,
+		       int height, uint32_t *output ) {
+  if(      algo == "copy" )       { copy( image, width, height, output ); }	
+  else if( algo == "block2" )     { block2( image, width, height, output ); }	
+  else if( algo == "block3" )     { block3( image, width, height, output ); } 
+  else if( algo == "scale2x" )    { scale2x( image, width, height, output ); }
+  else if( algo == "scale2xPad" ) { scale2xPad( image, width, height, output );}
+  else if( algo == "scale2xSFX" ) { scale2xSFX( image, width, height, output );}
+  else if( algo == "mmpx" )       { mmpx2x( image, width, height, output ); }
+  else if( algo == "2xSaI" )      { scale2xSaI( image, width, height, output ); }
+  else if( algo == "super2xSaI" ) { scaleSuper2xSaI( image, width, height, output ); }
+  else if( algo == "superEagle" ) { scaleSuperEagle( image, width, height, output ); }
+  else if( algo == "scale3x" )    { scale3xPad( image, width, height, output );}
+  else if( algo == "scale3xSFX" ) { scale3xSFX( image, width, height, output );}
+  else if( algo == "hq2xA" )      { hq2xA( image, width, height, output ); }
+  else if( algo == "hq2xB" )      { hq2xB( image, width, height, output ); }
+  else if( algo == "hq3xA" )      { hq3xA( image, width, height, output ); }
+  else if( algo == "hq3xB" )      { hq3xB( image, width, height, output ); }
+  else if( algo == "superXBR" ) { scaleSuperXBR( image, width, height, output);}
+  else if( algo == "superXBR4x" ) { scaleSuperXBR4x(image, width, height, output);}
+  else if( algo == "superXBR8x" ) { scaleSuperXBR8x(image, width, height, output);}
+  else if( algo == "xbr2x" )      { scaleXBR2x( image, width, height, output ); }
+  else if( algo == "xbr3x" )      { scaleXBR3x( image, width, height, output ); }
+  else if( algo == "xbr4x" )      { scaleXBR4x( image, width, height, output ); }
+#ifdef WITH_XBRZ
+  else if( algo == "xbrz2x" )     { scaleXBRZ2x( image, width, height, output ); }
+  else if( algo == "xbrz3x" )     { scaleXBRZ3x( image, width, height, output ); }
+  else if( algo == "xbrz4x" )     { scaleXBRZ4x( image, width, height, output ); }
+  else if( algo == "xbrz5x" )     { scaleXBRZ5x( image, width, height, output ); }
+  else if( algo == "xbrz6x" )     { scaleXBRZ6x( image, width, height, output ); }
+#endif
+  else if( algo == "rotsprite" )  { rotSprite( image, width, height, output ); }
+  else {
+    // should never happen...
+  }
+}
+
+// The scalers that only copy colors also run on the index plane of a
+// palettized image, as loaded with the padding they need.
+static bool indexedScaler( const string &algo ) {
+  return algo == "copy" || algo == "block2" || algo == "block3" ||
+    algo == "scale2x" || algo == "scale2xPad" || algo == "mmpx" ||
+    algo == "scale3x";
+}
+
+static void runIndexedScaler( const string &algo, uint8_t *index, int width,
+			      int height, const uint32_t *palette,
+			      uint8_t *output ) {
+  if(      algo == "copy" )       { copy( index, width, height, output ); }
+  else if( algo == "block2" )     { block2( index, width, height, output ); }
+  else if( algo == "block3" )     { block3( index, width, height, output ); }
+  else if( algo == "scale2x" )    { scale2x( index, width, height, output ); }
+  else if( algo == "scale2xPad" ) { scale2xPad( index, width, height, output );}
+  else if( algo == "mmpx" )       { mmpx2x( index, width, height, output, palette ); }
+  else if( algo == "scale3x" )    { scale3xPad( index, width, height, output );}
+}
+
+// Scales the image and passes the result to sink row by row, top to
+// bottom.
+// The scalers are local, so they can run on horizontal strips of the
+// input: padded ones read the neighbors of the strip from the padding
+// rows around it, which are simply the rows of the full image, and the
+// others get a copy of the strip with a halo of neighbor rows, whose
+// output is dropped. Only one strip of the scaled image is ever held in
+// memory.
+//
+// The superXBR family is the exception, deliberately. Its third pass runs
+// bottom-up, and each pixel depends on the rewritten pixels below and to
+// its right, so no row is final before every row under it is. Rows can
+// only come out bottom-up, while the resampler and the writers take them
+// top-down. The passes also start with a border that is replayed top-down.
+// So is rotsprite, whose rows depend on input columns rather than rows.
+// For both, the result, of outW x outH pixels, is passed on as a whole.
+static void scaleStreaming( const string &algo, uint32_t *image, int width,
+			    int height, int factor, int padding,
+			    int outW, int outH,
+			    const std::function<void(const uint32_t*)> &sink ) {
+  const int strip = 32;		// input rows per strip
+  const int halo = 2;
+
+  int W = width*factor;
+
+  if( algo.compare( 0, 8, "superXBR" ) == 0 || algo == "rotsprite" ) {
+    std::vector<uint32_t> full( (long)outW*outH );
+    runScaler( algo, image, width, height, &full[0] );
+    for( int j=0; j<outH; j++ ) {
+      sink( &full[ (long)j*outW ] );
+    }
+    return;
+  }
+
+  std::vector<uint32_t> in, out( (long)W*(strip+2*halo)*factor );
+  if( padding == 0 ) {
+    in.resize( (long)width*(strip+2*halo) );
+  }
+
+  for( int y0=0; y0<height; y0+=strip ) {
+    int n = std::min( strip, height-y0 );
+    int top = 0;
+
+    if( padding > 0 ) {
+      runScaler( algo, image + (long)y0*(width+2*padding), width, n, &out[0] );
+    } else {
+      top = std::min( halo, y0 );
+      int bottom = std::min( halo, height-y0-n );
+      std::copy( image + (long)(y0-top)*width,
+		 image + (long)(y0+n+bottom)*width, in.begin() );
+      runScaler( algo, &in[0], width, top+n+bottom, &out[0] );
+    }
+
+    for( int j=top*factor; j<(top+n)*factor; j++ ) {
+      sink( &out[ (long)j*W ] );
+    }
+  }
+}
+
+static bool hasExtension( const string &file, const string &ext ) {
+  return file.size() > ext.size() &&
+    file.compare( file.size()-ext.size(), ext.size(), ext ) == 0;
+}
+
+// The first byte of a file, without taking it from standard input.
+static int firstByte( const string &file ) {
+  if( file == "-" ) {
+    return ungetc( getc( stdin ), stdin );
+  }
+
+  FILE *f = fopen( file.c_str(), "rb" );
+  if( !f ) { return EOF; }
+  int c = getc( f );
+  fclose( f );
+  return c;
+}
+
+// Writes the output as an 8-bit palettized BMP. The palette of the input,
+// if any (colors > 0), comes first, in the same order, so that indices
+// carry over for algorithms that only copy colors; other colors are
+// appended.
+static int saveIndexed( const uint32_t *output, uint32_t w, uint32_t h,
+			const uint32_t *inPalette, int colors,
+			const string &outfile, bool topDown ) {
+  uint32_t palette[256];
+  std::copy( inPalette, inPalette + colors, palette );
+
+  uint8_t *index = new uint8_t[(size_t)w*h];
+  int res = indexBitmap( output, (long)w*h, index, palette, colors );
+  if( res != 0 ) {
+    std::cerr << "Output has more than 256 colors, can not use --bits 8"
+	      << std::endl;
+  } else {
+    res = saveIndexedBitmap( index, palette, colors, w, h, outfile, topDown );
+  }
+  delete[] index;
+  return res;
+}
+
+// Takes 2 or 3 arguments: algo infile outfile, optionally preceded by
+// options of the form --name value.
 // If only two args are present, output filename defaults to "output.bmp"
 // The first arg, giving the algo must be present and be one of:...
 int main(int argc, char **argv )
@@ -54,20 +246,116 @@ int main(int argc, char **argv )
   string algo = "";
   string infile = "";
   string outfile = "output.bmp";
+  bool memo = false;
+  int sizeW = 0, sizeH = 0;
+  int bits = 24;
+  bool topDown = false;
+  BitmapHeaderVersion header = BMP_V5;
+  string format = "";
+  RowResampler::Filter filter = RowResampler::Area;
+
+  std::vector<string> args;
+  for( int i=1; i<argc; i++ ) {
+    string opt = argv[i];
+
+    if( opt == "--threads" && i+1 < argc ) {
+      setThreadCount( atoi( argv[++i] ) );
+    } else if( opt == "--memo" ) {
+      memo = true;
+      setSuperXBRMemo( true );
+    } else if( opt == "--bits" && i+1 < argc ) {
+      bits = atoi( argv[++i] );
+      if( bits != 8 && bits != 24 && bits != 32 ) {
+	std::cerr << "Unsupported bit depth " << bits << std::endl;
+	return 1;
+      }
+    } else if( opt == "--top-down" ) {
+      topDown = true;
+    } else if( opt == "--header" && i+1 < argc ) {
+      string v = argv[++i];
+      if(      v == "info" ) { header = BMP_INFO; }
+      else if( v == "v4" )   { header = BMP_V4; }
+      else if( v == "v5" )   { header = BMP_V5; }
+      else {
+	std::cerr << "Unknown header version " << v << std::endl;
+	print_usage( 0 );
+	return 1;
+      }
+    } else if( opt == "--angle" && i+1 < argc ) {
+      setRotSpriteAngle( atof( argv[++i] ) );
+    } else if( opt == "--size" && i+1 < argc ) {
+      string size = argv[++i];
+      size_t x = size.find( 'x' );
+      if( x != string::npos ) {
+	sizeW = atoi( size.substr( 0, x ).c_str() );
+	sizeH = atoi( size.substr( x+1 ).c_str() );
+      }
+      if( sizeW <= 0 || sizeH <= 0 ) {
+	std::cerr << "Bad size " << size << ", expected WxH" << std::endl;
+	return 1;
+      }
+    } else if( opt == "--resample" && i+1 < argc ) {
+      string f = argv[++i];
+      if(      f == "area" )     { filter = RowResampler::Area; }
+      else if( f == "bilinear" ) { filter = RowResampler::Bilinear; }
+      else {
+	std::cerr << "Unknown resampling filter " << f << std::endl;
+	print_usage( 0 );
+	return 1;
+      }
+    } else if( opt == "--format" && i+1 < argc ) {
+      format = argv[++i];
+      if( format != "bmp" && format != "ppm" && format != "pam" &&
+	  format != "qoi" ) {
+	std::cerr << "Unknown format " << format << std::endl;
+	print_usage( 0 );
+	return 1;
+      }
+    } else if( opt.compare( 0, 2, "--" ) == 0 ) {
+      std::cerr << "Unknown option " << opt << std::endl;
+      print_usage(0);
+      return 1;
+    } else {
+      args.push_back( opt );
+    }
+  }
   
   // in, out = stdin, stdout  
-  if( argc > 3 ) { outfile = argv[3]; }
-  if( argc > 2 ) { infile = argv[2];  }
+  if( args.size() > 2 ) { outfile = args[2]; }
+  if( args.size() > 1 ) { infile = args[1];  }
   
-  if( argc > 1 )  {
-    algo = argv[1];
+  if( args.size() > 0 )  {
+    algo = args[0];
   } else {
     print_usage(0);
     return 0;
   }
 
+  // split off a preset, as in superXBR:fast or xbr2x:lv3
+  size_t colon = algo.find( ':' );
+  if( colon != string::npos ) {
+    string preset = algo.substr( colon+1 );
+    algo = algo.substr( 0, colon );
+
+    bool super = algo.compare( 0, 8, "superXBR" ) == 0;
+    bool xbr = algo == "xbr2x" || algo == "xbr3x" || algo == "xbr4x";
+    if( !super && !xbr ) {
+      print_usage( 1 );
+      return 0;
+    }
+    if(      super && preset == "fast" ) { setSuperXBRFast( true ); }
+    else if( super && preset == "full" ) { setSuperXBRFast( false ); }
+    else if( xbr && preset == "lv2" )    { setXBRLevel( 2 ); }
+    else if( xbr && preset == "lv3" )    { setXBRLevel( 3 ); }
+    else {
+      std::cerr << "Unknown preset " << preset << std::endl;
+      print_usage( 0 );
+      return 1;
+    }
+  }
+
   uint32_t factor = 1;
-  uint16_t padding = 0;
+  int padding = 0;
 
   if(      algo == "copy" )       { factor = 1; padding = 0; }
   else if( algo == "block2" )     { factor = 2; padding = 0; }
@@ -75,6 +363,10 @@ int main(int argc, char **argv )
   else if( algo == "scale2x" )    { factor = 2; padding = 0; }
   else if( algo == "scale2xPad" ) { factor = 2; padding = 1; }
   else if( algo == "scale2xSFX" ) { factor = 2; padding = 2; }
+  else if( algo == "mmpx" )       { factor = 2; padding = 3; }
+  else if( algo == "2xSaI" )      { factor = 2; padding = 2; }
+  else if( algo == "super2xSaI" ) { factor = 2; padding = 2; }
+  else if( algo == "superEagle" ) { factor = 2; padding = 2; }
   else if( algo == "scale3x" )    { factor = 3; padding = 1; }
   else if( algo == "scale3xSFX" ) { factor = 3; padding = 2; } 
   else if( algo == "hq2xA" )      { factor = 2; padding = 0; }
@@ -82,46 +374,220 @@ int main(int argc, char **argv )
   else if( algo == "hq3xA" )      { factor = 3; padding = 0; }
   else if( algo == "hq3xB" )      { factor = 3; padding = 0; }
   else if( algo == "superXBR" )   { factor = 2; padding = 0; }  
+  else if( algo == "superXBR4x" ) { factor = 4; padding = 0; }
+  else if( algo == "superXBR8x" ) { factor = 8; padding = 0; }
+  else if( algo == "xbr2x" )      { factor = 2; padding = 2; }
+  else if( algo == "xbr3x" )      { factor = 3; padding = 2; }
+  else if( algo == "xbr4x" )      { factor = 4; padding = 2; }
+#ifdef WITH_XBRZ
+  else if( algo == "xbrz2x" )     { factor = 2; padding = 2; }
+  else if( algo == "xbrz3x" )     { factor = 3; padding = 2; }
+  else if( algo == "xbrz4x" )     { factor = 4; padding = 2; }
+  else if( algo == "xbrz5x" )     { factor = 5; padding = 2; }
+  else if( algo == "xbrz6x" )     { factor = 6; padding = 2; }
+#endif
+  else if( algo == "rotsprite" )  { factor = 1; padding = 0; }
   else {
     print_usage( 1 );
     return 0;
   }   
   
-  // load the input image
-  uint16_t width, height;
+  // the output format goes by the extension, unless given
+  bool raw = format.empty() && hasExtension( outfile, ".raw" );
+  if( format.empty() ) {
+    if(      hasExtension( outfile, ".ppm" ) ) { format = "ppm"; }
+    else if( hasExtension( outfile, ".pam" ) ) { format = "pam"; }
+    else if( hasExtension( outfile, ".qoi" ) ) { format = "qoi"; }
+    else { format = "bmp"; }
+  }
+  bool pnm = format == "ppm" || format == "pam";
+  bool qoi = format == "qoi";
+
+  if( ( pnm || qoi ) && bits != 24 ) {
+    std::cerr << "--bits applies to BMP output only" << std::endl;
+    return 1;
+  }
+  if( outfile == "-" && bits == 32 ) {
+    std::cerr << "32-bit BMP output can not go to standard output,"
+	      << " use --format pam" << std::endl;
+    return 1;
+  }
+
+  // load the input image: netpbm files start with P, QOI files with qoif,
+  // BMP files with BM. For 8-bit output, a palettized BMP keeps its
+  // palette, whose order the output follows, and its indices, which the
+  // scalers that only copy colors work on directly.
+  uint32_t width, height;
   uint32_t *image = NULL;
-  if( int res = loadBitmapPadded(infile, image, width, height, padding) ) {
+  uint8_t *index = NULL;
+  uint32_t palette[256];
+  int colors = 0;
+  int first = firstByte( infile ), res;
+  if(      first == 'P' ) { res = loadPnmPadded( infile, image, width, height, padding ); }
+  else if( first == 'q' ) { res = loadQoiPadded( infile, image, width, height, padding ); }
+  else if( bits == 8 ) {
+    res = loadIndexedBitmap( infile, image, index, palette, colors,
+			     width, height, padding );
+  }
+  else { res = loadBitmapPadded( infile, image, width, height, padding ); }
+  if( res ) {
     std::cerr << "Loading image failed " << res << std::endl;
     return 1;
   }
+
+  bool indexed = index && sizeW == 0 && indexedScaler( algo );
+  if( index && !indexed ) {
+    image = expandIndexed( index, palette,
+			   (size_t)(width+2*padding)*(height+2*padding) );
+    delete[] index;
+    index = NULL;
+    if( !image ) {
+      std::cerr << "Not enough memory for the input" << std::endl;
+      return 1;
+    }
+  }
     
-  // resize the input image using the given scale factor
-  uint32_t outputSize = (width * factor) * (height * factor);
-  uint32_t *output = new uint32_t[outputSize]();
+  // resize the input image using the given scale factor, then to the
+  // requested size, if any.
+  // The scalers step through their output with int offsets of up to a
+  // few rows at a time, which limits every side to INT32_MAX/8 pixels.
+  const long maxSide = INT32_MAX / 8;
+  long scaledW = (long)width*factor, scaledH = (long)height*factor;
+  if( algo == "rotsprite" && width <= maxSide && height <= maxSide ) {
+    int w, h;
+    rotSpriteSize( width, height, w, h );
+    scaledW = w; scaledH = h;
+  }
+
+  long outWidth = scaledW, outHeight = scaledH;
+  if( sizeW > 0 ) { outWidth = sizeW; outHeight = sizeH; }
+
+  size_t outputSize = 0;
+  if( std::max( scaledW, scaledH ) > maxSide ||
+      std::max( outWidth, outHeight ) > maxSide ||
+      __builtin_mul_overflow( (size_t)outWidth, (size_t)outHeight,
+			      &outputSize ) ||
+      outputSize > SIZE_MAX / sizeof(uint32_t) ) {
+    std::cerr << "Image too large: scales to " << scaledW << "x" << scaledH
+	      << ", output is " << outWidth << "x" << outHeight << std::endl;
+    releaseBitmap( image );
+    delete[] index;
+    return 1;
+  }
+
+  // 32-bit and raw output is mapped, and the scaler writes into the file.
+  // Netpbm, QOI, and top-down 24-bit output is written as the rows come
+  // out of the scaler, so the output image is never in memory as a whole;
+  // anything else goes through a full output buffer.
+  bool mapped = raw || bits == 32;
+  bool streamed = pnm || qoi || ( !mapped && topDown && bits == 24 );
+
+  // the scalers keep an opaque image opaque; rotsprite adds a
+  // transparent background
+  bool alpha = algo == "rotsprite" || ( image &&
+    !isOpaque( image, (long)(width+2*padding)*(height+2*padding) ) );
+
+  uint32_t *output = NULL;
+  uint8_t *indexOutput = NULL;
+  BitmapWriter writer;
+  PnmWriter pnmWriter;
+  QoiWriter qoiWriter;
+  bool failed = false;
+  if( mapped ) {
+    output = mapBitmap( outfile, outWidth, outHeight, raw ? BMP_NONE : header );
+    failed = !output;
+  } else if( pnm ) {
+    failed = pnmWriter.open( outfile, outWidth, outHeight,
+			     format == "pam" ) != 0;
+  } else if( qoi ) {
+    failed = qoiWriter.open( outfile, outWidth, outHeight, alpha ) != 0;
+  } else if( streamed ) {
+    failed = writer.open( outfile, outWidth, outHeight, true ) != 0;
+  } else if( indexed ) {
+    indexOutput = new (std::nothrow) uint8_t[outputSize]();
+    failed = !indexOutput;
+  } else {
+    output = new (std::nothrow) uint32_t[outputSize]();
+    failed = !output;
+  }
+  if( failed ) {
+    std::cerr << ( mapped || streamed ?
+		   "Creating output file failed" :
+		   "Not enough memory for the output" ) << std::endl;
+    releaseBitmap( image );
+    delete[] index;
+    return 1;
+  }
+
+  // where finished rows go, when they come one at a time
+  long row = 0;
+  std::function<void(const uint32_t*)> sink = [&]( const uint32_t *p ) {
+    if( pnm ) {
+      pnmWriter.write( p, 1 );
+    } else if( qoi ) {
+      qoiWriter.write( p, 1 );
+    } else if( streamed ) {
+      writer.write( p, 1 );
+    } else {
+      std::copy( p, p + outWidth, output + row*outWidth );
+    }
+    row++;
+  };
 
   std::cerr<<"Scaling now: "<<algo<<" "<<width<<"x"<<height<<std::endl;
-  if(      algo == "copy" )       { copy( image, width, height, output ); }	
-  else if( algo == "block2" )     { block2( image, width, height, output ); }	
-  else if( algo == "block3" )     { block3( image, width, height, output ); } 
-  else if( algo == "scale2x" )    { scale2x( image, width, height, output ); }
-  else if( algo == "scale2xPad" ) { scale2xPad( image, width, height, output );}
-  else if( algo == "scale2xSFX" ) { scale2xSFX( image, width, height, output );}
-  else if( algo == "scale3x" )    { scale3xPad( image, width, height, output );}
-  else if( algo == "scale3xSFX" ) { scale3xSFX( image, width, height, output );}
-  else if( algo == "hq2xA" )      { hq2xA( image, width, height, output ); }
-  else if( algo == "hq2xB" )      { hq2xB( image, width, height, output ); }
-  else if( algo == "hq3xA" )      { hq3xA( image, width, height, output ); }
-  else if( algo == "hq3xB" )      { hq3xB( image, width, height, output ); }
-  else if( algo == "superXBR" ) { scaleSuperXBR( image, width, height, output);}
-  else {
-    // should never happen...
+  if( indexed ) {
+    runIndexedScaler( algo, index, width, height, palette, indexOutput );
+  } else if( sizeW > 0 ) {
+    RowResampler rs( filter, scaledW, scaledH, outWidth, outHeight, alpha,
+		     sink );
+    scaleStreaming( algo, image, width, height, factor, padding,
+		    scaledW, scaledH,
+		    [&]( const uint32_t *p ) { rs.push( p ); } );
+  } else if( streamed ) {
+    scaleStreaming( algo, image, width, height, factor, padding,
+		    scaledW, scaledH, sink );
+  } else {
+    runScaler( algo, image, width, height, output );
+  }
+
+  if( memo && algo.compare( 0, 8, "superXBR" ) == 0 ) {
+    long lookups[3], hits[3];
+    superXBRMemoStats( lookups, hits );
+    for( int p=0; p<3; p++ ) {
+      std::cerr << "Memo pass " << p+1 << ": " << hits[p] << "/" << lookups[p]
+		<< " hits (" << ( lookups[p] ? 100*hits[p]/lookups[p] : 0 ) << "%)"
+		<< std::endl;
+    }
   }
 
   // saves the resized image
-  if( saveBitmap(output, width*factor, height*factor, outfile) != 0 ) {
+  int saved = 0;
+  if( pnm ) {
+    saved = pnmWriter.close();
+  } else if( qoi ) {
+    saved = qoiWriter.close();
+  } else if( streamed ) {
+    saved = writer.close();
+  } else if( indexed ) {
+    saved = saveIndexedBitmap( indexOutput, palette, colors, outWidth,
+			       outHeight, outfile, topDown );
+  } else if( bits == 8 ) {
+    saved = saveIndexed( output, outWidth, outHeight, palette, colors,
+			 outfile, topDown );
+  } else if( !mapped ) {
+    saved = saveBitmap( output, outWidth, outHeight, outfile );
+  }
+  if( saved != 0 ) {
     std::cerr << "Saving image failed " << std::endl;
   }
 
-  delete[] image;
-  delete[] output;
+  releaseBitmap( image );
+  delete[] index;
+  delete[] indexOutput;
+  if( mapped ) {
+    releaseBitmap( output );
+  } else {
+    delete[] output;
+  }
+  return saved != 0;
 }
@@ -0,0 +1,72 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+static int threads = 0;
+
+void setThreadCount( int n ) {
+  threads = n < 0 ? 0 : n;
+}
+
+int threadCount() {
+  if( threads > 0 ) { return threads; }
+
+  int n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+void parallelRun( const std::function<void(int, int)> &fn ) {
+  int n = threadCount();
+
+  if( n == 1 ) {
+    fn( 0, 1 );
+    return;
+  }
+
+  std::vector<std::thread> pool;
+  for( int t=1; t<n; t++ ) {
+    pool.emplace_back( fn, t, n );
+  }
+  fn( 0, n );
+
+  for( auto &th : pool ) {
+    th.join();
+  }
+}
+
+void parallelBands( int begin, int end,
+		    const std::function<void(int, int)> &fn ) {
+  parallelRun( [&]( int t, int n ) {
+      long long len = end - begin;
+      int b = begin + (int)( len*t/n );
+      int e = begin + (int)( len*(t+1)/n );
+      if( b < e ) { fn( b, e ); }
+    } );
+}
@@ -0,0 +1,208 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "pnm.h"
+#include "bitmap.h"
+
+using std::string;
+
+// Reads the next word of a header, skipping white space and comments, and
+// the one white-space character after the word, which for the last one
+// is all that separates the header from the pixels.
+static bool word( FILE *in, string &w ) {
+  int c = getc( in );
+  while( c == '#' || isspace( c ) ) {
+    if( c == '#' ) {
+      while( c != '\n' && c != EOF ) { c = getc( in ); }
+    }
+    c = getc( in );
+  }
+
+  w.clear();
+  while( c != EOF && !isspace( c ) && w.size() < 32 ) {
+    w += (char)c;
+    c = getc( in );
+  }
+  return !w.empty();
+}
+
+static bool number( FILE *in, uint32_t &n ) {
+  string w;
+  if( !word( in, w ) || w.find_first_not_of( "0123456789" ) != string::npos ) {
+    return false;
+  }
+  unsigned long v = strtoul( w.c_str(), NULL, 10 );
+  n = v;
+  return v <= INT32_MAX;
+}
+
+// Reads the header of a PPM or PAM; depth is the number of samples per
+// pixel. Error codes follow the BMP loader.
+static int readHeader( FILE *in, uint32_t &width, uint32_t &height,
+		       uint32_t &depth ) {
+  string w;
+  uint32_t maxval = 0;
+  width = height = depth = 0;
+
+  if( !word( in, w ) ) { return -1; }
+
+  if( w == "P6" ) {
+    depth = 3;
+    if( !number( in, width ) || !number( in, height ) ||
+	!number( in, maxval ) ) {
+      return -2;
+    }
+  } else if( w == "P7" ) {
+    while( word( in, w ) && w != "ENDHDR" ) {
+      bool ok = true;
+      if(      w == "WIDTH" )    { ok = number( in, width ); }
+      else if( w == "HEIGHT" )   { ok = number( in, height ); }
+      else if( w == "DEPTH" )    { ok = number( in, depth ); }
+      else if( w == "MAXVAL" )   { ok = number( in, maxval ); }
+      else if( w == "TUPLTYPE" ) { ok = word( in, w ); }	// goes by depth
+      else { ok = false; }
+      if( !ok ) { return -2; }
+    }
+    if( w != "ENDHDR" ) { return -2; }
+  } else {
+    return -1;
+  }
+
+  if( width == 0 || height == 0 ) { return -2; }
+  if( depth < 1 || depth > 4 || maxval != 255 ) { return -5; }
+  return 0;
+}
+
+// Gray, gray and alpha, RGB, or RGBA samples to 32-bit pixels.
+static void decodeRow( const uint8_t *src, uint32_t *dst, uint32_t width,
+		       uint32_t depth ) {
+  for( uint32_t x=0; x<width; x++, src += depth ) {
+    uint32_t r, g, b, a = 0xFF;
+    if( depth < 3 ) {
+      r = g = b = src[0];
+      if( depth == 2 ) { a = src[1]; }
+    } else {
+      r = src[0]; g = src[1]; b = src[2];
+      if( depth == 4 ) { a = src[3]; }
+    }
+    dst[x] = a << 24 | r << 16 | g << 8 | b;
+  }
+}
+
+static void encodeRow( const uint32_t *src, uint8_t *dst, uint32_t width,
+		       uint32_t depth ) {
+  for( uint32_t x=0; x<width; x++, dst += depth ) {
+    uint32_t v = src[x];
+    dst[0] = v >> 16; dst[1] = v >> 8; dst[2] = v;
+    if( depth == 4 ) { dst[3] = v >> 24; }
+  }
+}
+
+int loadPnmPadded( const string &fileName, uint32_t *&data,
+		   uint32_t &width, uint32_t &height, int pad ) {
+  FILE *in = fileName == "-" ? stdin : fopen( fileName.c_str(), "rb" );
+  if( !in ) { return -1; }
+
+  uint32_t depth;
+  int res = readHeader( in, width, height, depth );
+
+  // the scalers index rows with int, padding included
+  if( res == 0 && ( width > (uint32_t)(INT32_MAX - 2*pad) ||
+		    height > (uint32_t)(INT32_MAX - 2*pad) ) ) {
+    res = -2;
+  }
+
+  size_t fullWidth = width + 2*pad;
+  data = NULL;
+  if( res == 0 ) {
+    data = new (std::nothrow) uint32_t[fullWidth*(height + 2*pad)]();
+    if( !data ) { res = -1; }
+  }
+
+  std::vector<uint8_t> row( res == 0 ? (size_t)width*depth : 0 );
+  for( uint32_t y=0; res == 0 && y<height; y++ ) {
+    if( fread( &row[0], 1, row.size(), in ) != row.size() ) {
+      res = -4;
+    } else {
+      decodeRow( &row[0], data + (pad+y)*fullWidth + pad, width, depth );
+    }
+  }
+  if( in != stdin ) { fclose( in ); }
+
+  if( res != 0 ) {
+    delete[] data;
+    data = NULL;
+    return res;
+  }
+  fillPadding( data, width, height, pad );
+  return 0;
+}
+
+// Writes the header, and sets up a staging buffer of about 1MB, as
+// BitmapWriter does.
+int PnmWriter::open( const string &fileName, uint32_t width,
+		     uint32_t height, bool alpha ) {
+  output = openOutput( fileName, file );
+  if( !output ) { return -1; }
+
+  if( alpha ) {
+    *output << "P7\nWIDTH " << width << "\nHEIGHT " << height
+	    << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+  } else {
+    *output << "P6\n" << width << " " << height << "\n255\n";
+  }
+
+  this->width = width;
+  depth = alpha ? 4 : 3;
+  capacity = std::max( 1u, (1u << 20) / (width*depth) );
+  used = 0;
+  buf.assign( (size_t)width*depth*capacity, 0 );
+
+  return output->good() ? 0 : -1;
+}
+
+void PnmWriter::write( const uint32_t *rows, uint32_t n ) {
+  for( uint32_t k=0; k<n; k++, rows += width ) {
+    encodeRow( rows, &buf[ (size_t)used*width*depth ], width, depth );
+    if( ++used == capacity ) { flush(); }
+  }
+}
+
+void PnmWriter::flush() {
+  output->write( (char*)&buf[0], (std::streamsize)width*depth*used );
+  used = 0;
+}
+
+int PnmWriter::close() {
+  flush();
+  return closeOutput( output, file );
+}
@@ -0,0 +1,259 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <new>
+
+#include "qoi.h"
+#include "bitmap.h"
+
+using std::string;
+
+// Chunk tags. The two 8-bit ones take precedence over the 2-bit ones,
+// whose values they overlap (a run of 63 or 64 can not be coded).
+enum {
+  OP_INDEX = 0x00, OP_DIFF = 0x40, OP_LUMA = 0x80, OP_RUN = 0xC0,
+  OP_RGB = 0xFE, OP_RGBA = 0xFF
+};
+
+// Pixels here are 0xAARRGGBB, as everywhere in pixelscaler.
+static inline uint32_t red( uint32_t v )   { return (v >> 16) & 0xFF; }
+static inline uint32_t green( uint32_t v ) { return (v >> 8) & 0xFF; }
+static inline uint32_t blue( uint32_t v )  { return v & 0xFF; }
+static inline uint32_t alpha( uint32_t v ) { return v >> 24; }
+
+static inline int hash( uint32_t v ) {
+  return ( red(v)*3 + green(v)*5 + blue(v)*7 + alpha(v)*11 ) % 64;
+}
+
+static const uint8_t endMarker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+// Reads a file a block at a time, and hands it out a byte at a time.
+struct ByteReader {
+  FILE *in;
+  std::vector<uint8_t> buf;
+  size_t pos, len;
+
+  ByteReader( FILE *in ) : in( in ), buf( 1 << 16 ), pos( 0 ), len( 0 ) {}
+
+  int get() {
+    if( pos == len ) {
+      len = fread( &buf[0], 1, buf.size(), in );
+      pos = 0;
+      if( len == 0 ) { return -1; }
+    }
+    return buf[pos++];
+  }
+};
+
+static uint32_t bigEndian( const uint8_t *p ) {
+  return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+int loadQoiPadded( const string &fileName, uint32_t *&data,
+		   uint32_t &width, uint32_t &height, int pad ) {
+  FILE *in = fileName == "-" ? stdin : fopen( fileName.c_str(), "rb" );
+  if( !in ) { return -1; }
+
+  // magic, width, height, channels, color space
+  uint8_t head[14];
+  int res = 0;
+  if( fread( head, 1, 14, in ) != 14 ) {
+    res = -1;
+  } else if( head[0] != 'q' || head[1] != 'o' || head[2] != 'i' ||
+	     head[3] != 'f' ) {
+    res = -1;
+  } else {
+    width = bigEndian( head+4 );
+    height = bigEndian( head+8 );
+
+    // the scalers index rows with int, padding included
+    if( width == 0 || height == 0 || head[12] < 3 || head[12] > 4 ||
+	width > (uint32_t)(INT32_MAX - 2*pad) ||
+	height > (uint32_t)(INT32_MAX - 2*pad) ) {
+      res = -2;
+    }
+  }
+
+  size_t fullWidth = width + 2*pad;
+  data = NULL;
+  if( res == 0 ) {
+    data = new (std::nothrow) uint32_t[fullWidth*(height + 2*pad)]();
+    if( !data ) { res = -1; }
+  }
+
+  ByteReader r( in );
+  uint32_t px = 0xFF000000, index[64] = { 0 };
+  int run = 0;
+
+  for( uint32_t y=0; res == 0 && y<height; y++ ) {
+    uint32_t *q = data + (pad+y)*fullWidth + pad;
+
+    for( uint32_t x=0; x<width; x++ ) {
+      if( run > 0 ) {
+	run--;
+	q[x] = px;
+	continue;
+      }
+
+      int b1 = r.get();
+      if( b1 < 0 ) { res = -4; break; }
+
+      if( b1 == OP_RGB || b1 == OP_RGBA ) {
+	int c[4] = { r.get(), r.get(), r.get(), b1 == OP_RGBA ? r.get() : 0 };
+	if( c[0] < 0 || c[1] < 0 || c[2] < 0 || c[3] < 0 ) { res = -4; break; }
+	px = ( b1 == OP_RGBA ? (uint32_t)c[3] << 24 : px & 0xFF000000 ) |
+	  c[0] << 16 | c[1] << 8 | c[2];
+      } else if( ( b1 & 0xC0 ) == OP_INDEX ) {
+	px = index[b1];
+      } else if( ( b1 & 0xC0 ) == OP_DIFF ) {
+	uint32_t dr = ( b1 >> 4 & 3 ) - 2, dg = ( b1 >> 2 & 3 ) - 2;
+	uint32_t db = ( b1 & 3 ) - 2;
+	px = ( px & 0xFF000000 ) | ( ( red(px) + dr ) & 0xFF ) << 16 |
+	  ( ( green(px) + dg ) & 0xFF ) << 8 | ( ( blue(px) + db ) & 0xFF );
+      } else if( ( b1 & 0xC0 ) == OP_LUMA ) {
+	int b2 = r.get();
+	if( b2 < 0 ) { res = -4; break; }
+	uint32_t dg = ( b1 & 0x3F ) - 32;
+	uint32_t dr = dg - 8 + ( b2 >> 4 ), db = dg - 8 + ( b2 & 0x0F );
+	px = ( px & 0xFF000000 ) | ( ( red(px) + dr ) & 0xFF ) << 16 |
+	  ( ( green(px) + dg ) & 0xFF ) << 8 | ( ( blue(px) + db ) & 0xFF );
+      } else {
+	run = b1 & 0x3F;	// this pixel, and run more
+      }
+
+      index[ hash( px ) ] = px;
+      q[x] = px;
+    }
+  }
+  if( in != stdin ) { fclose( in ); }
+
+  if( res != 0 ) {
+    delete[] data;
+    data = NULL;
+    return res;
+  }
+  fillPadding( data, width, height, pad );
+  return 0;
+}
+
+// Writes the header, and sets up a staging buffer of about 1MB, as
+// BitmapWriter does.
+int QoiWriter::open( const string &fileName, uint32_t width,
+		     uint32_t height, bool alpha ) {
+  output = openOutput( fileName, file );
+  if( !output ) { return -1; }
+
+  uint8_t head[14] = { 'q', 'o', 'i', 'f',
+		       (uint8_t)( width >> 24 ), (uint8_t)( width >> 16 ),
+		       (uint8_t)( width >> 8 ), (uint8_t)width,
+		       (uint8_t)( height >> 24 ), (uint8_t)( height >> 16 ),
+		       (uint8_t)( height >> 8 ), (uint8_t)height,
+		       (uint8_t)( alpha ? 4 : 3 ), 0 };	// sRGB
+  output->write( (char*)head, sizeof(head) );
+
+  this->width = width;
+  opaque = alpha ? 0 : 0xFF000000;
+  prev = 0xFF000000;
+  std::fill( index, index+64, 0 );
+  run = 0;
+
+  // room for a row of the longest chunks, a run left over from the row
+  // before, and the end marker
+  buf.assign( std::max( (size_t)1 << 20, (size_t)5*width + 9 ), 0 );
+  used = 0;
+
+  return output->good() ? 0 : -1;
+}
+
+void QoiWriter::write( const uint32_t *rows, uint32_t n ) {
+  for( uint32_t k=0; k<n; k++, rows += width ) {
+    if( used + 5*(size_t)width + 1 > buf.size() ) { flush(); }
+    uint8_t *q = &buf[used];
+
+    for( uint32_t x=0; x<width; x++ ) {
+      uint32_t px = rows[x] | opaque;
+
+      if( px == prev ) {
+	if( ++run == 62 ) {
+	  *q++ = OP_RUN | ( run-1 );
+	  run = 0;
+	}
+	continue;
+      }
+      if( run > 0 ) {
+	*q++ = OP_RUN | ( run-1 );
+	run = 0;
+      }
+
+      int h = hash( px );
+      if( index[h] == px ) {
+	*q++ = OP_INDEX | h;
+      } else if( alpha(px) != alpha(prev) ) {
+	index[h] = px;
+	*q++ = OP_RGBA;
+	*q++ = red(px); *q++ = green(px); *q++ = blue(px); *q++ = alpha(px);
+      } else {
+	index[h] = px;
+	int8_t dr = red(px) - red(prev), dg = green(px) - green(prev);
+	int8_t db = blue(px) - blue(prev);
+	int8_t dgr = dr - dg, dgb = db - dg;
+
+	if( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 &&
+	    db >= -2 && db <= 1 ) {
+	  *q++ = OP_DIFF | ( dr+2 ) << 4 | ( dg+2 ) << 2 | ( db+2 );
+	} else if( dgr >= -8 && dgr <= 7 && dg >= -32 && dg <= 31 &&
+		   dgb >= -8 && dgb <= 7 ) {
+	  *q++ = OP_LUMA | ( dg+32 );
+	  *q++ = ( dgr+8 ) << 4 | ( dgb+8 );
+	} else {
+	  *q++ = OP_RGB;
+	  *q++ = red(px); *q++ = green(px); *q++ = blue(px);
+	}
+      }
+      prev = px;
+    }
+    used = q - &buf[0];
+  }
+}
+
+void QoiWriter::flush() {
+  output->write( (char*)&buf[0], (std::streamsize)used );
+  used = 0;
+}
+
+int QoiWriter::close() {
+  if( used + 9 > buf.size() ) { flush(); }
+  if( run > 0 ) {
+    buf[used++] = OP_RUN | ( run-1 );
+    run = 0;
+  }
+  std::copy( endMarker, endMarker+8, &buf[used] );
+  used += 8;
+  flush();
+  return closeOutput( output, file );
+}
@@ -0,0 +1,169 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+
+#include "resample.h"
+
+// Taps that average the source pixels an output pixel covers. In units
+// of 1/(src*dst) of the full length, source pixel i covers
+// [i*dst, (i+1)*dst) and output pixel x covers [x*src, (x+1)*src); the
+// weights are the integer overlaps, so they are exact and sum to one.
+void RowResampler::areaTaps( int src, int dst, Taps &t ) {
+  for( int x=0; x<dst; x++ ) {
+    long long lo = (long long)x*src, hi = (long long)(x+1)*src;
+    int i0 = lo/dst, i1 = (hi-1)/dst;
+
+    t.start.push_back( i0 );
+    t.count.push_back( i1-i0+1 );
+    t.offset.push_back( t.weight.size() );
+
+    for( int i=i0; i<=i1; i++ ) {
+      long long a = std::max( lo, (long long)i*dst );
+      long long b = std::min( hi, (long long)(i+1)*dst );
+      t.weight.push_back( (float)(b-a)/src );
+    }
+  }
+}
+
+// Taps that interpolate linearly between the two source pixels nearest
+// to the center of each output pixel; clamped at the edges.
+void RowResampler::bilinearTaps( int src, int dst, Taps &t ) {
+  for( int x=0; x<dst; x++ ) {
+    double s = (x+0.5)*src/dst - 0.5;
+    s = std::min( std::max( s, 0.0 ), (double)(src-1) );
+
+    int i0 = (int)s;
+    float f = s - i0;
+
+    t.start.push_back( i0 );
+    t.offset.push_back( t.weight.size() );
+    if( f > 0 && i0+1 < src ) {
+      t.count.push_back( 2 );
+      t.weight.push_back( 1-f );
+      t.weight.push_back( f );
+    } else {
+      t.count.push_back( 1 );
+      t.weight.push_back( 1 );
+    }
+  }
+}
+
+RowResampler::RowResampler( Filter filter, int srcW, int srcH, int outW,
+			    int outH, bool alpha,
+			    const std::function<void(const uint32_t*)> &sink )
+  : srcW(srcW), outW(outW), outH(outH), alpha(alpha), sink(sink),
+    srcRow(0), firstOpen(0), nextOpen(0)
+{
+  if( filter == Area ) {
+    areaTaps( srcW, outW, cols );
+    areaTaps( srcH, outH, rows );
+  } else {
+    bilinearTaps( srcW, outW, cols );
+    bilinearTaps( srcH, outH, rows );
+  }
+
+  // Output rows start and end in order, so the rows that are open while
+  // a given source row comes in are contiguous; size the ring for the
+  // largest such run.
+  ring = 1;
+  for( int y0=0, y1=0, r=0; r<srcH; r++ ) {
+    while( y1 < outH && rows.start[y1] <= r ) { y1++; }
+    while( y0 < y1 && rows.start[y0] + rows.count[y0] <= r ) { y0++; }
+    ring = std::max( ring, y1-y0 );
+  }
+
+  hrow.resize( 4*outW );
+  acc.resize( (long)4*outW*ring );
+  orow.resize( outW );
+}
+
+void RowResampler::push( const uint32_t *row ) {
+  int r = srcRow++;
+
+  // horizontal pass, all four channels. With alpha, the colors are
+  // premultiplied on the way in. Alpha is floored at a small fraction of
+  // a step, which keeps the color of transparent areas without letting
+  // it bleed into visible pixels (and never changes the rounded alpha).
+  for( int x=0; x<outW; x++ ) {
+    const uint32_t *p = row + cols.start[x];
+    const float *w = &cols.weight[ cols.offset[x] ];
+    float c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+
+    for( int k=0; k<cols.count[x]; k++ ) {
+      float wa = w[k]*( p[k]>>24 ), wc = w[k];
+      if( alpha ) {
+	wa = w[k]*std::max( (float)( p[k]>>24 ), 1/256.0f );
+	wc = wa*( 1/255.0f );
+      }
+      c0 += wc*( p[k] & 0xFF );
+      c1 += wc*( (p[k]>>8) & 0xFF );
+      c2 += wc*( (p[k]>>16) & 0xFF );
+      c3 += wa;
+    }
+    hrow[4*x] = c0; hrow[4*x+1] = c1; hrow[4*x+2] = c2; hrow[4*x+3] = c3;
+  }
+
+  // open the output rows that start here
+  while( nextOpen < outH && rows.start[nextOpen] <= r ) {
+    float *a = &acc[ (long)4*outW*(nextOpen % ring) ];
+    std::fill( a, a + 4*outW, 0.0f );
+    nextOpen++;
+  }
+
+  // vertical pass: add this row to every open output row that uses it
+  for( int y=firstOpen; y<nextOpen; y++ ) {
+    int k = r - rows.start[y];
+    if( k >= rows.count[y] ) { continue; }
+
+    float w = rows.weight[ rows.offset[y] + k ];
+    float *a = &acc[ (long)4*outW*(y % ring) ];
+    for( int i=0; i<4*outW; i++ ) {
+      a[i] += w*hrow[i];
+    }
+  }
+
+  // write out the rows that are complete
+  while( firstOpen < nextOpen &&
+	 rows.start[firstOpen] + rows.count[firstOpen] <= r+1 ) {
+    const float *a = &acc[ (long)4*outW*(firstOpen % ring) ];
+    uint32_t *q = &orow[0];
+
+    for( int x=0; x<outW; x++ ) {
+      // undo the premultiplication
+      float s = alpha ? 255/a[4*x+3] : 1;
+
+      uint32_t v = 0;
+      for( int c=3; c>=0; c-- ) {
+	int b = (int)( ( c == 3 ? a[4*x+c] : s*a[4*x+c] ) + 0.5f );
+	v = (v<<8) | std::min( std::max( b, 0 ), 255 );
+      }
+      q[x] = v;
+    }
+    sink( q );
+    firstOpen++;
+  }
+}
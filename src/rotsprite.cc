@@ -0,0 +1,158 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "rotsprite.h"
+#include "scalenx.h"
+#include "parallel.h"
+
+// RotSprite by Xenowhirl: https://en.wikipedia.org/wiki/Pixel-art_scaling_algorithms#RotSprite
+// The image is scaled to 8x with scale2x, applied three times, rotated,
+// and sampled back at the original resolution, nearest neighbor.
+//
+// The 8x image is never built as a whole. Output is produced in square
+// tiles; for each tile, only the part of the input that the tile maps
+// back to is copied out, with a halo of 2 pixels, and scaled up. scale2x
+// only looks at the immediate neighbors, so after three rounds the cut
+// edges have affected less than two input pixels' worth of the 8x tile,
+// none of which is sampled: the result is the same as rotating the full
+// 8x image, but memory stays bounded by the tile size, and the work by
+// the number of output pixels.
+
+static double angle = 0;
+
+static const int tile = 64;	// output pixels per tile side
+static const int halo = 2;
+
+void setRotSpriteAngle( double degrees ) {
+  angle = degrees;
+}
+
+// Multiples of 90 degrees are made exact, so that pixel centers keep
+// landing in the same place and straight edges stay straight.
+static void sinCos( double &s, double &c ) {
+  double a = std::fmod( angle, 360.0 );
+  if( a < 0 ) { a += 360; }
+
+  if(      a ==   0 ) { s =  0; c =  1; }
+  else if( a ==  90 ) { s =  1; c =  0; }
+  else if( a == 180 ) { s =  0; c = -1; }
+  else if( a == 270 ) { s = -1; c =  0; }
+  else {
+    s = std::sin( a*M_PI/180 );
+    c = std::cos( a*M_PI/180 );
+  }
+}
+
+void rotSpriteSize( int w, int h, int &outW, int &outH ) {
+  double s, c;
+  sinCos( s, c );
+
+  // the small allowance keeps rounding noise from adding a pixel
+  outW = (int)std::ceil( std::fabs(w*c) + std::fabs(h*s) - 1e-6 );
+  outH = (int)std::ceil( std::fabs(w*s) + std::fabs(h*c) - 1e-6 );
+}
+
+void rotSprite( uint32_t *img, int w, int h, uint32_t *out ) {
+  double s, c;
+  sinCos( s, c );
+
+  int outW, outH;
+  rotSpriteSize( w, h, outW, outH );
+
+  // Maps the center of output pixel (x, y) back into the input, in units
+  // of input pixels; the rotation is counterclockwise on screen, with y
+  // pointing down.
+  auto source = [&]( int x, int y, double &u, double &v ) {
+    double dx = x + 0.5 - outW/2.0;
+    double dy = y + 0.5 - outH/2.0;
+    u = w/2.0 + dx*c - dy*s;
+    v = h/2.0 + dx*s + dy*c;
+  };
+
+  int tilesX = (outW + tile-1)/tile;
+  int tilesY = (outH + tile-1)/tile;
+
+  parallelBands( 0, tilesY, [&]( int ty0, int ty1 ) {
+      std::vector<uint32_t> buf[4];
+
+      for( int ty=ty0; ty<ty1; ty++ ) {
+	for( int tx=0; tx<tilesX; tx++ ) {
+	  int x0 = tx*tile, x1 = std::min( x0+tile, outW );
+	  int y0 = ty*tile, y1 = std::min( y0+tile, outH );
+
+	  // input area the tile maps to: the map is affine, so the corner
+	  // pixels give its extent
+	  double umin = w, umax = 0, vmin = h, vmax = 0;
+	  for( int k=0; k<4; k++ ) {
+	    double u, v;
+	    source( k&1 ? x1-1 : x0, k&2 ? y1-1 : y0, u, v );
+	    umin = std::min( umin, u ); umax = std::max( umax, u );
+	    vmin = std::min( vmin, v ); vmax = std::max( vmax, v );
+	  }
+
+	  int i0 = std::max( 0, (int)std::floor(umin) - halo );
+	  int i1 = std::min( w, (int)std::floor(umax) + 1 + halo );
+	  int j0 = std::max( 0, (int)std::floor(vmin) - halo );
+	  int j1 = std::min( h, (int)std::floor(vmax) + 1 + halo );
+
+	  int rw = i1 - i0, rh = j1 - j0;
+	  if( rw > 0 && rh > 0 ) {
+	    buf[0].resize( (long)rw*rh );
+	    for( int j=0; j<rh; j++ ) {
+	      std::copy( img + (long)(j0+j)*w + i0,
+			 img + (long)(j0+j)*w + i1, &buf[0][ (long)j*rw ] );
+	    }
+	    for( int k=1; k<4; k++ ) {
+	      int m = 1<<(k-1);
+	      buf[k].resize( (long)rw*rh*4*m*m );
+	      scale2x( &buf[k-1][0], m*rw, m*rh, &buf[k][0] );
+	    }
+	  }
+
+	  for( int y=y0; y<y1; y++ ) {
+	    uint32_t *q = out + (long)y*outW;
+	    for( int x=x0; x<x1; x++ ) {
+	      double u, v;
+	      source( x, y, u, v );
+
+	      if( u < 0 || u >= w || v < 0 || v >= h || rw <= 0 || rh <= 0 ) {
+		q[x] = 0;
+		continue;
+	      }
+
+	      long px = (long)std::floor( 8*u ) - 8*i0;
+	      long py = (long)std::floor( 8*v ) - 8*j0;
+	      q[x] = buf[3][ py*8*rw + px ];
+	    }
+	  }
+	}
+      }
+    } );
+}
@@ -0,0 +1,284 @@
+/*
+
+MIT License
+
+Copyright (c) 2022 Philipp K. Janert
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdint>
+
+#include "sai.h"
+
+// The 2xSaI family by Derek Liauw Kie Fa (Kreed):
+// https://vdnoort.home.xs4all.nl/emulation/2xsai/
+//
+// All three look at a 4x4 window around the 2x2 block A B / C D of input
+// pixels, and fill the 2x2 output block of A from it:
+//
+//      I E F J
+//      G A B K
+//      H C D L
+//      M N O P
+//
+// Rules follow the reference implementation. Impls require 2px padding on
+// all four sides (only one is needed on the top and left).
+//
+// Blending works on all four 8-bit channels of a pixel at once: each
+// channel is shifted right after masking off the bits that would spill
+// into its neighbor, and the low bits that were masked off are summed
+// separately. No unpacking, and the compiler is free to vectorize.
+
+static inline uint32_t blend2( uint32_t a, uint32_t b ) {
+  return ((a & 0xFEFEFEFE)>>1) + ((b & 0xFEFEFEFE)>>1) + (a & b & 0x01010101);
+}
+
+static inline uint32_t blend4( uint32_t a, uint32_t b, uint32_t c, uint32_t d ){
+  uint32_t hi = ((a & 0xFCFCFCFC)>>2) + ((b & 0xFCFCFCFC)>>2) +
+                ((c & 0xFCFCFCFC)>>2) + ((d & 0xFCFCFCFC)>>2);
+  uint32_t lo = (a & 0x03030303) + (b & 0x03030303) +
+                (c & 0x03030303) + (d & 0x03030303);
+  return hi + ((lo>>2) & 0x03030303);
+}
+
+// 3:1 mix of a and b
+static inline uint32_t blend31( uint32_t a, uint32_t b ) {
+  return blend4( a, a, a, b );
+}
+
+// 3:1 mix the way SuperEagle's reference builds it, out of two halvings;
+// each rounds down on its own, so it can come out a step below blend31
+static inline uint32_t blend2of2( uint32_t a, uint32_t b ) {
+  return blend2( a, blend2( a, b ) );
+}
+
+// +1 if c and d are both b, -1 if they are both a, 0 otherwise (as the
+// reference's GetResult). Summed over the four sides of an X crossing, it
+// favors the color that the surrounding pixels do not continue.
+static inline int vote( uint32_t a, uint32_t b, uint32_t c, uint32_t d ) {
+  return (a != c || a != d) - (b != c || b != d);
+}
+
+void scale2xSaI( uint32_t *img, int w, int h, uint32_t *out ) {
+  int pad = 2;
+  int scl = 2;
+
+  long V = w + 2*pad;
+
+  uint32_t *p = img + pad*V + pad;
+  uint32_t *q1 = out;
+  uint32_t *q2 = out + scl*w;
+
+  uint32_t I, E, F, J, G, A, B, K, H, C, D, L, M, N, O;
+  uint32_t e1, e2, e3;
+
+  for( int j=0; j<h; j++ ) {
+    for( int i=0; i<w; i++ ) {
+      I = p[i-V-1]; E = p[i-V]; F = p[i-V+1]; J = p[i-V+2];
+      G = p[i-1];   A = p[i];   B = p[i+1];   K = p[i+2];
+      H = p[i+V-1]; C = p[i+V]; D = p[i+V+1]; L = p[i+V+2];
+      M = p[i+2*V-1]; N = p[i+2*V]; O = p[i+2*V+1];
+
+      if( A == D && B != C ) {
+	e1 = (A==E && B==L) || (A==C && A==F && B!=E && B==J) ? A:blend2(A, B);
+	e2 = (A==G && C==O) || (A==B && A==H && G!=C && C==M) ? A:blend2(A, C);
+	e3 = A;
+
+      } else if( B == C && A != D ) {
+	e1 = (B==F && A==H) || (B==E && B==D && A!=F && A==I) ? B:blend2(A, B);
+	e2 = (C==H && A==F) || (C==G && C==D && A!=H && A==I) ? C:blend2(A, C);
+	e3 = B;
+
+      } else if( A == D && B == C ) {
+	if( A == B ) {
+	  e1 = e2 = e3 = A;
+	} else {
+	  e1 = blend2( A, B );
+	  e2 = blend2( A, C );
+
+	  int r = vote(A, B, G, E) - vote(B, A, K, F)
+	    - vote(B, A, H, N) + vote(A, B, L, O);
+	  e3 = r > 0 ? A : r < 0 ? B : blend4( A, B, C, D );
+	}
+
+      } else {
+	e3 = blend4( A, B, C, D );
+
+	if(      A==C && A==F && B!=E && B==J ) { e1 = A; }
+	else if( B==E && B==D && A!=F && A==I ) { e1 = B; }
+	else { e1 = blend2( A, B ); }
+
+	if(      A==B && A==H && G!=C && C==M ) { e2 = A; }
+	else if( C==G && C==D && A!=H && A==I ) { e2 = C; }
+	else { e2 = blend2( A, C ); }
+      }
+
+      q1[ scl*i ] = A;
+      q1[scl*i+1] = e1;
+      q2[ scl*i ] = e2;
+      q2[scl*i+1] = e3;
+    }
+
+    p += V;
+    q1 += scl*scl*w;
+    q2 += scl*scl*w;
+  }
+}
+
+// Super2xSaI and SuperEagle use the same window, but with the names from
+// the reference implementation:
+//
+//      B0 B1 B2 B3
+//      C4 C5 C6 S2
+//      C1 C2 C3 S1
+//      A0 A1 A2 A3
+
+void scaleSuper2xSaI( uint32_t *img, int w, int h, uint32_t *out ) {
+  int pad = 2;
+  int scl = 2;
+
+  long V = w + 2*pad;
+
+  uint32_t *p = img + pad*V + pad;
+  uint32_t *q1 = out;
+  uint32_t *q2 = out + scl*w;
+
+  uint32_t B0, B1, B2, B3, C4, C5, C6, S2, C1, C2, C3, S1, A0, A1, A2, A3;
+  uint32_t e0, e1, e2, e3;
+
+  for( int j=0; j<h; j++ ) {
+    for( int i=0; i<w; i++ ) {
+      B0 = p[i-V-1];   B1 = p[i-V];   B2 = p[i-V+1];   B3 = p[i-V+2];
+      C4 = p[i-1];     C5 = p[i];     C6 = p[i+1];     S2 = p[i+2];
+      C1 = p[i+V-1];   C2 = p[i+V];   C3 = p[i+V+1];   S1 = p[i+V+2];
+      A0 = p[i+2*V-1]; A1 = p[i+2*V]; A2 = p[i+2*V+1]; A3 = p[i+2*V+2];
+
+      if( C2 == C6 && C5 != C3 ) {
+	e1 = e3 = C2;
+
+      } else if( C5 == C3 && C2 != C6 ) {
+	e1 = e3 = C5;
+
+      } else if( C5 == C3 && C2 == C6 ) {
+	int r = vote(C6, C5, C1, A1) + vote(C6, C5, C4, B1)
+	  + vote(C6, C5, A2, S1) + vote(C6, C5, B2, S2);
+	e1 = e3 = r > 0 ? C6 : r < 0 ? C5 : blend2( C5, C6 );
+
+      } else {
+	if( C6==C3 && C3==A1 && C2!=A2 && C3!=A0 )      { e3 = blend31(C3, C2); }
+	else if( C5==C2 && C2==A2 && A1!=C3 && C2!=A3 ) { e3 = blend31(C2, C3); }
+	else { e3 = blend2( C2, C3 ); }
+
+	if( C6==C3 && C6==B1 && C5!=B2 && C6!=B0 )      { e1 = blend31(C6, C5); }
+	else if( C5==C2 && C5==B2 && B1!=C6 && C5!=B3 ) { e1 = blend31(C5, C6); }
+	else { e1 = blend2( C5, C6 ); }
+      }
+
+      if( (C5==C3 && C2!=C6 && C4==C5 && C5!=A2) ||
+	  (C5==C1 && C6==C5 && C4!=C2 && C5!=A0) ) {
+	e2 = blend2( C2, C5 );
+      } else {
+	e2 = C2;
+      }
+
+      if( (C2==C6 && C5!=C3 && C1==C2 && C2!=B2) ||
+	  (C4==C2 && C3==C2 && C1!=C5 && C2!=B0) ) {
+	e0 = blend2( C2, C5 );
+      } else {
+	e0 = C5;
+      }
+
+      q1[ scl*i ] = e0;
+      q1[scl*i+1] = e1;
+      q2[ scl*i ] = e2;
+      q2[scl*i+1] = e3;
+    }
+
+    p += V;
+    q1 += scl*scl*w;
+    q2 += scl*scl*w;
+  }
+}
+
+void scaleSuperEagle( uint32_t *img, int w, int h, uint32_t *out ) {
+  int pad = 2;
+  int scl = 2;
+
+  long V = w + 2*pad;
+
+  uint32_t *p = img + pad*V + pad;
+  uint32_t *q1 = out;
+  uint32_t *q2 = out + scl*w;
+
+  uint32_t B1, B2, C4, C5, C6, S2, C1, C2, C3, S1, A1, A2;
+  uint32_t e0, e1, e2, e3;
+
+  for( int j=0; j<h; j++ ) {
+    for( int i=0; i<w; i++ ) {
+      B1 = p[i-V];   B2 = p[i-V+1];
+      C4 = p[i-1];   C5 = p[i];     C6 = p[i+1];   S2 = p[i+2];
+      C1 = p[i+V-1]; C2 = p[i+V];   C3 = p[i+V+1]; S1 = p[i+V+2];
+      A1 = p[i+2*V]; A2 = p[i+2*V+1];
+
+      if( C2 == C6 && C5 != C3 ) {
+	e1 = e2 = C2;
+	e0 = C1==C2 || C6==B2 ? blend2of2( C2, C5 ) : blend2( C5, C6 );
+	e3 = C6==S2 || C2==A1 ? blend2of2( C2, C3 ) : blend2( C2, C3 );
+
+      } else if( C5 == C3 && C2 != C6 ) {
+	e0 = e3 = C5;
+	e1 = B1==C5 || C3==S1 ? blend2of2( C5, C6 ) : blend2( C5, C6 );
+	e2 = C3==A1 || C4==C5 ? blend2of2( C5, C2 ) : blend2( C2, C3 );
+
+      } else if( C5 == C3 && C2 == C6 ) {
+	int r = vote(C6, C5, C1, A1) + vote(C6, C5, C4, B1)
+	  + vote(C6, C5, A2, S1) + vote(C6, C5, B2, S2);
+	if( r > 0 ) {
+	  e1 = e2 = C2;
+	  e0 = e3 = blend2( C5, C6 );
+	} else if( r < 0 ) {
+	  e0 = e3 = C5;
+	  e1 = e2 = blend2( C5, C6 );
+	} else {
+	  e0 = e3 = C5;
+	  e1 = e2 = C2;
+	}
+
+      } else {
+	uint32_t x = blend2( C2, C6 );
+	uint32_t y = blend2( C5, C3 );
+	e0 = blend31( C5, x );
+	e1 = blend31( C6, y );
+	e2 = blend31( C2, y );
+	e3 = blend31( C3, x );
+      }
+
+      q1[ scl*i ] = e0;
+      q1[scl*i+1] = e1;
+      q2[ scl*i ] = e2;
+      q2[scl*i+1] = e3;
+    }
+
+    p += V;
+    q1 += scl*scl*w;
+    q2 += scl*scl*w;
+  }
+}
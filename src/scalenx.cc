@@ -30,13 +30,14 @@ SOFTWARE.
 #include "scalenx.h"
 
 // Copies input to output, pixel by pixel. No scaling. Mostly for testing.
-void copy( uint32_t *img, int w, int h, uint32_t *out ) {
-  uint32_t *p = img;
-  uint32_t *q = out;
+template<typename T>
+static void copyT( T *img, int w, int h, T *out ) {
+  T *p = img;
+  T *q = out;
   
   for( int j=0; j<h; j++ ) {
-    p = img + j*w;
-    q = out + j*w;
+    p = img + (long)j*w;
+    q = out + (long)j*w;
     
     for( int i=0; i<w; i++ ) {
       q[i] = p[i];
@@ -45,13 +46,14 @@ void copy( uint32_t *img, int w, int h, uint32_t *out ) {
 }
 
 // Expands every input pixel to a 2x2 block. No interpolation.
-void block2( uint32_t *img, int w, int h, uint32_t *out ) {
-  uint32_t *p = img;
-  uint32_t *q = out;
+template<typename T>
+static void block2T( T *img, int w, int h, T *out ) {
+  T *p = img;
+  T *q = out;
   
   for( int j=0; j<h; j++ ) {
-    p = img + j*w;   
-    q = out + 2*2*j*w;
+    p = img + (long)j*w;   
+    q = out + 2*2*(long)j*w;
     
     for( int i=0; i<w; i++ ) {
       q[2*i] = p[i];
@@ -63,13 +65,14 @@ void block2( uint32_t *img, int w, int h, uint32_t *out ) {
 }
 
 // Expands every input pixel to a 3x3 block. No interpolation.
-void block3( uint32_t *img, int w, int h, uint32_t *out ) {
-  uint16_t scl = 3;  
-
-  uint32_t *p = img;
-  uint32_t *q1 = out;
-  uint32_t *q2 = q1 + scl*w;
-  uint32_t *q3 = q2 + scl*w;
+template<typename T>
+static void block3T( T *img, int w, int h, T *out ) {
+  int scl = 3;  
+
+  T *p = img;
+  T *q1 = out;
+  T *q2 = q1 + scl*w;
+  T *q3 = q2 + scl*w;
   
   for( int j=0; j<h; j++ ) {
     for( int i=0; i<w; i++ ) {
@@ -90,14 +93,15 @@ void block3( uint32_t *img, int w, int h, uint32_t *out ) {
 
 // scale2x algo: http://www.scale2x.it/algorithm
 // This version handles boundaries and does not require padded input
-void scale2x( uint32_t *img, int W, int H, uint32_t *out ) {
-  uint16_t scl = 2;
+template<typename T>
+static void scale2xT( T *img, int W, int H, T *out ) {
+  int scl = 2;
   
-  uint32_t *p = img;
-  uint32_t *q1 = out;
-  uint32_t *q2 = out + scl*W;
+  T *p = img;
+  T *q1 = out;
+  T *q2 = out + scl*W;
 
-  uint32_t b, d, e, f, h;
+  T b, d, e, f, h;
   
   for( int j=0; j<H; j++ ) {    
     for( int i=0; i<W; i++ ) {
@@ -125,16 +129,17 @@ void scale2x( uint32_t *img, int W, int H, uint32_t *out ) {
 }
 
 // Same as scale2x, but requires a 1px padding on all four sides.
-void scale2xPad( uint32_t *img, uint16_t W, uint16_t H, uint32_t *out ) {
-  uint16_t scl = 2;
-  uint16_t pad = 1;
+template<typename T>
+static void scale2xPadT( T *img, int W, int H, T *out ) {
+  int scl = 2;
+  int pad = 1;
   
-  uint16_t V = W+2*pad;
-  uint32_t *p = img + V + pad;
-  uint32_t *q1 = out;
-  uint32_t *q2 = out + scl*W;
+  long V = W+2*pad;
+  T *p = img + V + pad;
+  T *q1 = out;
+  T *q2 = out + scl*W;
 
-  uint32_t b, d, e, f, h;
+  T b, d, e, f, h;
   
   for( int j=0; j<H; j++ ) {    
     for( int i=0; i<W; i++ ) {
@@ -164,10 +169,10 @@ void scale2xPad( uint32_t *img, uint16_t W, uint16_t H, uint32_t *out ) {
 // Improved scale2x by Sp00kyFox. Impl requires 2px padding on all four sides. 
 // https://web.archive.org/web/20160527015550/https://libretro.com/forums/archive/index.php?t-1655.html
 void scale2xSFX( uint32_t *img, int w, int h, uint32_t *out ) {
-  uint16_t pad = 2;
-  uint16_t scl = 2;  
+  int pad = 2;
+  int scl = 2;  
 
-  uint16_t V = w + 2*pad;
+  long V = w + 2*pad;
 
   uint32_t *p = img + pad*V + pad;
   uint32_t *q1 = out;
@@ -221,20 +226,145 @@ void scale2xSFX( uint32_t *img, int w, int h, uint32_t *out ) {
 }
 
 
+// MMPX by Morgan McGuire and Mara Gagiu: https://casual-effects.com/research/McGuire2021PixelArt/
+// Follows the reference implementation. Only ever copies input colors, no
+// blending. Impl requires 3px padding on all four sides.
+//
+// All rules need at least one neighbor to differ from E. The test for
+// that is a branch-free OR over the 3x3 window, and flat regions (most
+// of a typical sprite) never reach the rules.
+
+// Brightness used to break ties; transparent pixels count as darkest.
+static inline uint32_t mmpxLuma( uint32_t c ) {
+  uint32_t alpha = c >> 24;
+  return ( ((c >> 16) & 0xFF) + ((c >> 8) & 0xFF) + (c & 0xFF) + 1 )*( 256 - alpha );
+}
+
+static inline bool allEq2( uint32_t b, uint32_t a0, uint32_t a1 ) {
+  return ( (b ^ a0) | (b ^ a1) ) == 0;
+}
+
+static inline bool allEq3( uint32_t b, uint32_t a0, uint32_t a1, uint32_t a2 ) {
+  return ( (b ^ a0) | (b ^ a1) | (b ^ a2) ) == 0;
+}
+
+static inline bool allEq4( uint32_t b, uint32_t a0, uint32_t a1, uint32_t a2,
+			   uint32_t a3 ) {
+  return ( (b ^ a0) | (b ^ a1) | (b ^ a2) | (b ^ a3) ) == 0;
+}
+
+static inline bool anyEq3( uint32_t b, uint32_t a0, uint32_t a1, uint32_t a2 ) {
+  return b == a0 || b == a1 || b == a2;
+}
+
+static inline bool noneEq2( uint32_t b, uint32_t a0, uint32_t a1 ) {
+  return b != a0 && b != a1;
+}
+
+static inline bool noneEq4( uint32_t b, uint32_t a0, uint32_t a1, uint32_t a2,
+			    uint32_t a3 ) {
+  return b != a0 && b != a1 && b != a2 && b != a3;
+}
+
+template<typename T, typename Luma>
+static void mmpx2xT( T *img, int w, int h, T *out, Luma luma ) {
+  int pad = 3;
+  int scl = 2;
+  long V = w + 2*pad;
+
+  T *p = img + pad*V + pad;
+  T *q1 = out;
+  T *q2 = out + scl*w;
+
+  for( int j=0; j<h; j++ ) {
+    // A B C
+    // D E F   carried along the row, C F I read fresh
+    // G H I
+    T A = p[-V-1], B = p[-V], D = p[-1], E = p[0], G = p[V-1], H = p[V];
+
+    for( int i=0; i<w; i++ ) {
+      T C = p[i-V+1], F = p[i+1], I = p[i+V+1];
+      T J = E, K = E, L = E, M = E;
+
+      if( ( (A^E) | (B^E) | (C^E) | (D^E) | (F^E) | (G^E) | (H^E) | (I^E) ) != 0 ) {
+	T P = p[i-2*V], S = p[i+2*V];
+	T Q = p[i-2], R = p[i+2];
+	uint32_t Bl = luma(B), Dl = luma(D), El = luma(E);
+	uint32_t Fl = luma(F), Hl = luma(H);
+
+	// 1:1 slope rules
+	if( (D == B && D != H && D != F) && (El >= Dl || E == A) && anyEq3(E, A, C, G) && (El < Dl || A != D || E != P || E != Q) ) { J = D; }
+	if( (B == F && B != D && B != H) && (El >= Bl || E == C) && anyEq3(E, A, C, I) && (El < Bl || C != B || E != P || E != R) ) { K = B; }
+	if( (H == D && H != F && H != B) && (El >= Hl || E == G) && anyEq3(E, A, G, I) && (El < Hl || G != H || E != S || E != Q) ) { L = H; }
+	if( (F == H && F != B && F != D) && (El >= Fl || E == I) && anyEq3(E, C, G, I) && (El < Fl || I != H || E != R || E != S) ) { M = F; }
+
+	// Intersection rules
+	if( (E != F && allEq4(E, C, I, D, Q) && allEq2(F, B, H)) && F != p[i+3] ) { K = M = F; }
+	if( (E != D && allEq4(E, A, G, F, R) && allEq2(D, B, H)) && D != p[i-3] ) { J = L = D; }
+	if( (E != H && allEq4(E, G, I, B, P) && allEq2(H, D, F)) && H != p[i+3*V] ) { L = M = H; }
+	if( (E != B && allEq4(E, A, C, H, S) && allEq2(B, D, F)) && B != p[i-3*V] ) { J = K = B; }
+
+	// Triangle tips
+	if( Bl < El && allEq4(E, G, H, I, S) && noneEq4(E, A, D, C, F) ) { J = K = B; }
+	if( Hl < El && allEq4(E, A, B, C, P) && noneEq4(E, D, G, I, F) ) { L = M = H; }
+	if( Fl < El && allEq4(E, A, D, G, Q) && noneEq4(E, B, C, I, H) ) { K = M = F; }
+	if( Dl < El && allEq4(E, C, F, I, R) && noneEq4(E, B, A, G, H) ) { J = L = D; }
+
+	// 2:1 slope rules
+	if( H != B ) {
+	  if( H != A && H != E && H != C ) {
+	    if( allEq3(H, G, F, R) && noneEq2(H, D, p[i-V+2]) ) { L = M; }
+	    if( allEq3(H, I, D, Q) && noneEq2(H, F, p[i-V-2]) ) { M = L; }
+	  }
+	  if( B != I && B != G && B != E ) {
+	    if( allEq3(B, A, F, R) && noneEq2(B, D, p[i+V+2]) ) { J = K; }
+	    if( allEq3(B, C, D, Q) && noneEq2(B, F, p[i+V-2]) ) { K = J; }
+	  }
+	}
+
+	if( F != D ) {
+	  if( D != I && D != E && D != C ) {
+	    if( allEq3(D, A, H, S) && noneEq2(D, B, p[i+2*V+1]) ) { J = L; }
+	    if( allEq3(D, G, B, P) && noneEq2(D, H, p[i-2*V+1]) ) { L = J; }
+	  }
+	  if( F != E && F != A && F != G ) {
+	    if( allEq3(F, C, H, S) && noneEq2(F, B, p[i+2*V-1]) ) { K = M; }
+	    if( allEq3(F, I, B, P) && noneEq2(F, H, p[i-2*V-1]) ) { M = K; }
+	  }
+	}
+      }
+
+      q1[ scl*i ] = J;
+      q1[scl*i+1] = K;
+      q2[ scl*i ] = L;
+      q2[scl*i+1] = M;
+
+      A = B; B = C;
+      D = E; E = F;
+      G = H; H = I;
+    }
+
+    p += V;
+    q1 += scl*scl*w;
+    q2 += scl*scl*w;
+  }
+}
+
 // scale3x algo: http://www.scale2x.it/algorithm
 // Impl requires 1px padding on all four sides.
-void scale3xPad( uint32_t *img, uint16_t w, uint16_t h, uint32_t *out ) {
-  uint16_t pad = 1;
-  uint16_t scl = 3;  
-  uint16_t V = w+2*pad;
+template<typename T>
+static void scale3xPadT( T *img, int w, int h, T *out ) {
+  int pad = 1;
+  int scl = 3;  
+  long V = w+2*pad;
   
-  uint32_t *p = img + V + pad;
-  uint32_t *q1 = out;
-  uint32_t *q2 = q1 + scl*w;
-  uint32_t *q3 = q2 + scl*w;
+  T *p = img + V + pad;
+  T *q1 = out;
+  T *q2 = q1 + scl*w;
+  T *q3 = q2 + scl*w;
 
-  uint32_t A, B, C, D, E, F, G, H, I;
-  uint32_t E0, E1, E2, E3, E4, E5, E6, E7, E8;
+  T A, B, C, D, E, F, G, H, I;
+  T E0, E1, E2, E3, E4, E5, E6, E7, E8;
   
   for( int j=0; j<h; j++ ) {    
     for( int i=0; i<w; i++ ) {
@@ -294,10 +424,10 @@ void scale3xPad( uint32_t *img, uint16_t w, uint16_t h, uint32_t *out ) {
 
 // Improved scale3x by Sp00kyFox. Impl requires 2px padding on all four sides. 
 // https://web.archive.org/web/20160527015550/https://libretro.com/forums/archive/index.php?t-1655.html
-void scale3xSFX( uint32_t *img, uint16_t w, uint16_t h, uint32_t *out ) {
-  uint16_t pad = 2;
-  uint16_t scl = 3;  
-  uint16_t V = w+2*pad;
+void scale3xSFX( uint32_t *img, int w, int h, uint32_t *out ) {
+  int pad = 2;
+  int scl = 3;  
+  long V = w+2*pad;
   
   uint32_t *p = img + pad*V + pad;
   uint32_t *q1 = out;
@@ -358,3 +488,68 @@ void scale3xSFX( uint32_t *img, uint16_t w, uint16_t h, uint32_t *out ) {
     q3 += scl*scl*w;    
   }
 }
+
+// The scalers that only ever copy colors run on 32-bit pixels, and on the
+// index planes of palettized images, where each pixel is a palette index.
+
+void copy( uint32_t *img, int w, int h, uint32_t *out ) {
+  copyT( img, w, h, out );
+}
+
+void copy( uint8_t *img, int w, int h, uint8_t *out ) {
+  copyT( img, w, h, out );
+}
+
+void block2( uint32_t *img, int w, int h, uint32_t *out ) {
+  block2T( img, w, h, out );
+}
+
+void block2( uint8_t *img, int w, int h, uint8_t *out ) {
+  block2T( img, w, h, out );
+}
+
+void block3( uint32_t *img, int w, int h, uint32_t *out ) {
+  block3T( img, w, h, out );
+}
+
+void block3( uint8_t *img, int w, int h, uint8_t *out ) {
+  block3T( img, w, h, out );
+}
+
+void scale2x( uint32_t *img, int W, int H, uint32_t *out ) {
+  scale2xT( img, W, H, out );
+}
+
+void scale2x( uint8_t *img, int W, int H, uint8_t *out ) {
+  scale2xT( img, W, H, out );
+}
+
+void scale2xPad( uint32_t *img, int W, int H, uint32_t *out ) {
+  scale2xPadT( img, W, H, out );
+}
+
+void scale2xPad( uint8_t *img, int W, int H, uint8_t *out ) {
+  scale2xPadT( img, W, H, out );
+}
+
+void scale3xPad( uint32_t *img, int w, int h, uint32_t *out ) {
+  scale3xPadT( img, w, h, out );
+}
+
+void scale3xPad( uint8_t *img, int w, int h, uint8_t *out ) {
+  scale3xPadT( img, w, h, out );
+}
+
+void mmpx2x( uint32_t *img, int w, int h, uint32_t *out ) {
+  mmpx2xT( img, w, h, out, []( uint32_t c ) { return mmpxLuma( c ); } );
+}
+
+// The brightness of an index is that of its palette color.
+void mmpx2x( uint8_t *img, int w, int h, uint8_t *out,
+	     const uint32_t *palette ) {
+  uint32_t luma[256];
+  for( int c=0; c<256; c++ ) {
+    luma[c] = mmpxLuma( palette[c] );
+  }
+  mmpx2xT( img, w, h, out, [&]( uint8_t c ) { return luma[c]; } );
+}
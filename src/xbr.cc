@@ -38,8 +38,14 @@ by Philipp K. Janert, September 2022
 #include <algorithm>
 #include <cstdint>
 #include <cmath>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include "xbr.h"
+#include "parallel.h"
+#include "bitmap.h"
 
 #define u32 uint32_t
 
@@ -109,20 +115,25 @@ sx, sy
 						 
 */
 
-float diagonal_edge(float mat[][4], float *wp) {
-	float dw1 = wp[0]*(df(mat[0][2], mat[1][1]) + df(mat[1][1], mat[2][0]) + df(mat[1][3], mat[2][2]) + df(mat[2][2], mat[3][1])) +\
-				wp[1]*(df(mat[0][3], mat[1][2]) + df(mat[2][1], mat[3][0])) + \
-				wp[2]*(df(mat[0][3], mat[2][1]) + df(mat[1][2], mat[3][0])) +\
-				wp[3]*df(mat[1][2], mat[2][1]) +\
-				wp[4]*(df(mat[0][2], mat[2][0]) + df(mat[1][3], mat[3][1])) +\
-				wp[5]*(df(mat[0][1], mat[1][0]) + df(mat[2][3], mat[3][2]));
-
-	float dw2 = wp[0]*(df(mat[0][1], mat[1][2]) + df(mat[1][2], mat[2][3]) + df(mat[1][0], mat[2][1]) + df(mat[2][1], mat[3][2])) +\
-				wp[1]*(df(mat[0][0], mat[1][1]) + df(mat[2][2], mat[3][3])) +\
-				wp[2]*(df(mat[0][0], mat[2][2]) + df(mat[1][1], mat[3][3])) +\
-				wp[3]*df(mat[1][1], mat[2][2]) +\
-				wp[4]*(df(mat[1][0], mat[3][2]) + df(mat[0][1], mat[2][3])) +\
-				wp[5]*(df(mat[0][2], mat[1][3]) + df(mat[2][0], mat[3][1]));
+// The weights are template arguments, one set per pass, so that terms with
+// a zero weight drop out and unit weights fold away at compile time. The
+// remaining terms are summed in the original order, so results are
+// unchanged.
+template<int W0, int W1, int W2, int W3, int W4, int W5>
+float diagonal_edge(float mat[][4]) {
+	float dw1 = W0*(df(mat[0][2], mat[1][1]) + df(mat[1][1], mat[2][0]) + df(mat[1][3], mat[2][2]) + df(mat[2][2], mat[3][1]));
+	if (W1 != 0) dw1 += W1*(df(mat[0][3], mat[1][2]) + df(mat[2][1], mat[3][0]));
+	if (W2 != 0) dw1 += W2*(df(mat[0][3], mat[2][1]) + df(mat[1][2], mat[3][0]));
+	if (W3 != 0) dw1 += W3*df(mat[1][2], mat[2][1]);
+	if (W4 != 0) dw1 += W4*(df(mat[0][2], mat[2][0]) + df(mat[1][3], mat[3][1]));
+	if (W5 != 0) dw1 += W5*(df(mat[0][1], mat[1][0]) + df(mat[2][3], mat[3][2]));
+
+	float dw2 = W0*(df(mat[0][1], mat[1][2]) + df(mat[1][2], mat[2][3]) + df(mat[1][0], mat[2][1]) + df(mat[2][1], mat[3][2]));
+	if (W1 != 0) dw2 += W1*(df(mat[0][0], mat[1][1]) + df(mat[2][2], mat[3][3]));
+	if (W2 != 0) dw2 += W2*(df(mat[0][0], mat[2][2]) + df(mat[1][1], mat[3][3]));
+	if (W3 != 0) dw2 += W3*df(mat[1][1], mat[2][2]);
+	if (W4 != 0) dw2 += W4*(df(mat[1][0], mat[3][2]) + df(mat[0][1], mat[2][3]));
+	if (W5 != 0) dw2 += W5*(df(mat[0][2], mat[1][3]) + df(mat[2][0], mat[3][1]));
 
 	return (dw1 - dw2);
 }
@@ -142,229 +153,374 @@ float cross_edge(float mat[][4], float *wp) {
 
 ///////////////////////// Super-xBR scaling
 // perform super-xbr (fast shader version) scaling by factor f=2 only.
-template<int f>
-void scaleSuperXBRT(u32* data, u32* out, int w, int h) {
-	int outw = w*f, outh = h*f;
-
-	float wp[6] = { 2.0f, 1.0f, -1.0f, 4.0f, -1.0f, 1.0f };
-
-	// First Pass
-	for (int y = 0; y < outh; ++y) {
-		for (int x = 0; x < outw; ++x) {
-			float r[4][4], g[4][4], b[4][4], a[4][4], Y[4][4];
-			int cx = x / f, cy = y / f; // central pixels on original images
-			// sample supporting pixels in original image
-			for (int sx = -1; sx <= 2; ++sx) {
-				for (int sy = -1; sy <= 2; ++sy) {
-					// clamp pixel locations
-					int csy = clamp(sy + cy, 0, h - 1);
-					int csx = clamp(sx + cx, 0, w - 1);
-					// sample & add weighted components
-					u32 sample = data[csy*w + csx];
-					r[sx + 1][sy + 1] = (float)R(sample);
-					g[sx + 1][sy + 1] = (float)G(sample);
-					b[sx + 1][sy + 1] = (float)B(sample);
-					a[sx + 1][sy + 1] = (float)A(sample);
-					Y[sx + 1][sy + 1] = (float)(0.2126*r[sx + 1][sy + 1] + 0.7152*g[sx + 1][sy + 1] + 0.0722*b[sx + 1][sy + 1]);
-				}
-			}
-			float min_r_sample = min4(r[1][1], r[2][1], r[1][2], r[2][2]);
-			float min_g_sample = min4(g[1][1], g[2][1], g[1][2], g[2][2]);
-			float min_b_sample = min4(b[1][1], b[2][1], b[1][2], b[2][2]);
-			float min_a_sample = min4(a[1][1], a[2][1], a[1][2], a[2][2]);
-			float max_r_sample = max4(r[1][1], r[2][1], r[1][2], r[2][2]);
-			float max_g_sample = max4(g[1][1], g[2][1], g[1][2], g[2][2]);
-			float max_b_sample = max4(b[1][1], b[2][1], b[1][2], b[2][2]);
-			float max_a_sample = max4(a[1][1], a[2][1], a[1][2], a[2][2]);
-			float d_edge = diagonal_edge(Y, &wp[0]);
-			float r1, g1, b1, a1, r2, g2, b2, a2, rf, gf, bf, af;
-			r1 = (float)w1*(r[0][3] + r[3][0]) + (float)w2*(r[1][2] + r[2][1]);
-			g1 = (float)w1*(g[0][3] + g[3][0]) + (float)w2*(g[1][2] + g[2][1]);
-			b1 = (float)w1*(b[0][3] + b[3][0]) + (float)w2*(b[1][2] + b[2][1]);
-			a1 = (float)w1*(a[0][3] + a[3][0]) + (float)w2*(a[1][2] + a[2][1]);
-			r2 = (float)w1*(r[0][0] + r[3][3]) + (float)w2*(r[1][1] + r[2][2]);
-			g2 = (float)w1*(g[0][0] + g[3][3]) + (float)w2*(g[1][1] + g[2][2]);
-			b2 = (float)w1*(b[0][0] + b[3][3]) + (float)w2*(b[1][1] + b[2][2]);
-			a2 = (float)w1*(a[0][0] + a[3][3]) + (float)w2*(a[1][1] + a[2][2]);
-			// generate and write result
-			if (d_edge <= 0.0f) { rf = r1; gf = g1; bf = b1; af = a1; }
-			else { rf = r2; gf = g2; bf = b2; af = a2; }
-			// anti-ringing, clamp.
-			rf = clamp(rf, min_r_sample, max_r_sample);
-			gf = clamp(gf, min_g_sample, max_g_sample);
-			bf = clamp(bf, min_b_sample, max_b_sample);
-			af = clamp(af, min_a_sample, max_a_sample);
-			int ri = clamp(static_cast<int>(ceilf(rf)), 0, 255);
-			int gi = clamp(static_cast<int>(ceilf(gf)), 0, 255);
-			int bi = clamp(static_cast<int>(ceilf(bf)), 0, 255);
-			int ai = clamp(static_cast<int>(ceilf(af)), 0, 255);
-			out[y*outw + x] = out[y*outw + x + 1] = out[(y + 1)*outw + x] = data[cy*w + cx];
-			out[(y+1)*outw + x+1] = (ai << 24) | (bi << 16) | (gi << 8) | ri;
-			++x;
+//
+// Each pass is split into a kernel for a single output location, and
+// scaleSuperXBRT() below schedules the kernels.
+//
+// Every kernel clamps its result to the range of the central 2x2 samples
+// of its window (anti-ringing). If those four samples are the same color,
+// the result is that color, whatever the rest of the window holds. The
+// kernels test for this on the packed pixels first and skip the float
+// work, which is most of the image for flat-shaded pixel art.
+
+inline bool uniform4(u32 a, u32 b, u32 c, u32 d) {
+	return ((a ^ b) | (a ^ c) | (a ^ d)) == 0;
+}
+
+// Pixel (x, y) of an image of size w*h, clamped to the image like the
+// window sampling in the kernels.
+inline u32 clamped_at(u32* img, int w, int h, int x, int y) {
+	return img[(long)clamp(y, 0, h - 1)*w + clamp(x, 0, w - 1)];
+}
+
+// Computes one output pixel from the 4x4 window win of packed pixels,
+// indexed [sx][sy], with the outer and inner weights wa and wb. The
+// result is clamped to the range of the central samples of rng, which is
+// the window itself except in the second half of pass 2.
+//
+// If the image is opaque, the result is too (it is clamped to the range
+// of opaque samples), so the alpha channel need not be computed at all.
+template<bool opaque, int W0, int W1, int W2, int W3, int W4, int W5>
+u32 superXBRFilter(u32 win[][4], u32 rng[][4], float wa, float wb) {
+	float r[4][4], g[4][4], b[4][4], a[4][4], Y[4][4];
+	for (int sx = 0; sx < 4; ++sx) {
+		for (int sy = 0; sy < 4; ++sy) {
+			u32 sample = win[sx][sy];
+			r[sx][sy] = (float)R(sample);
+			g[sx][sy] = (float)G(sample);
+			b[sx][sy] = (float)B(sample);
+			if (!opaque)
+				a[sx][sy] = (float)A(sample);
+			Y[sx][sy] = (float)(0.2126*r[sx][sy] + 0.7152*g[sx][sy] + 0.0722*b[sx][sy]);
 		}
-		++y;
 	}
-	
-
-
-	// Second Pass
-	wp[0] = 2.0f;
-	wp[1] = 0.0f;
-	wp[2] = 0.0f;
-	wp[3] = 0.0f;
-	wp[4] = 0.0f;
-	wp[5] = 0.0f;
-
-	for (int y = 0; y < outh; ++y) {
-		for (int x = 0; x < outw; ++x) {
-			float r[4][4], g[4][4], b[4][4], a[4][4], Y[4][4];
-			// sample supporting pixels in original image
-			for (int sx = -1; sx <= 2; ++sx) {
-				for (int sy = -1; sy <= 2; ++sy) {
-					// clamp pixel locations
-					int csy = clamp(sx - sy + y, 0, f*h - 1);
-					int csx = clamp(sx + sy + x, 0, f*w - 1);
-					// sample & add weighted components
-					u32 sample = out[csy*outw + csx];
-					r[sx + 1][sy + 1] = (float)R(sample);
-					g[sx + 1][sy + 1] = (float)G(sample);
-					b[sx + 1][sy + 1] = (float)B(sample);
-					a[sx + 1][sy + 1] = (float)A(sample);
-					Y[sx + 1][sy + 1] = (float)(0.2126*r[sx + 1][sy + 1] + 0.7152*g[sx + 1][sy + 1] + 0.0722*b[sx + 1][sy + 1]);
-				}
-			}
-			float min_r_sample = min4(r[1][1], r[2][1], r[1][2], r[2][2]);
-			float min_g_sample = min4(g[1][1], g[2][1], g[1][2], g[2][2]);
-			float min_b_sample = min4(b[1][1], b[2][1], b[1][2], b[2][2]);
-			float min_a_sample = min4(a[1][1], a[2][1], a[1][2], a[2][2]);
-			float max_r_sample = max4(r[1][1], r[2][1], r[1][2], r[2][2]);
-			float max_g_sample = max4(g[1][1], g[2][1], g[1][2], g[2][2]);
-			float max_b_sample = max4(b[1][1], b[2][1], b[1][2], b[2][2]);
-			float max_a_sample = max4(a[1][1], a[2][1], a[1][2], a[2][2]);
-			float d_edge = diagonal_edge(Y, &wp[0]);
-			float r1, g1, b1, a1, r2, g2, b2, a2, rf, gf, bf, af;
-			r1 = (float)w3*(r[0][3] + r[3][0]) + (float)w4*(r[1][2] + r[2][1]);
-			g1 = (float)w3*(g[0][3] + g[3][0]) + (float)w4*(g[1][2] + g[2][1]);
-			b1 = (float)w3*(b[0][3] + b[3][0]) + (float)w4*(b[1][2] + b[2][1]);
-			a1 = (float)w3*(a[0][3] + a[3][0]) + (float)w4*(a[1][2] + a[2][1]);
-			r2 = (float)w3*(r[0][0] + r[3][3]) + (float)w4*(r[1][1] + r[2][2]);
-			g2 = (float)w3*(g[0][0] + g[3][3]) + (float)w4*(g[1][1] + g[2][2]);
-			b2 = (float)w3*(b[0][0] + b[3][3]) + (float)w4*(b[1][1] + b[2][2]);
-			a2 = (float)w3*(a[0][0] + a[3][3]) + (float)w4*(a[1][1] + a[2][2]);
-			// generate and write result
-			if (d_edge <= 0.0f) { rf = r1; gf = g1; bf = b1; af = a1; }
-			else { rf = r2; gf = g2; bf = b2; af = a2; }
-			// anti-ringing, clamp.
-			rf = clamp(rf, min_r_sample, max_r_sample);
-			gf = clamp(gf, min_g_sample, max_g_sample);
-			bf = clamp(bf, min_b_sample, max_b_sample);
-			af = clamp(af, min_a_sample, max_a_sample);
-			int ri = clamp(static_cast<int>(ceilf(rf)), 0, 255);
-			int gi = clamp(static_cast<int>(ceilf(gf)), 0, 255);
-			int bi = clamp(static_cast<int>(ceilf(bf)), 0, 255);
-			int ai = clamp(static_cast<int>(ceilf(af)), 0, 255);
-			out[y*outw + x + 1] = (ai << 24) | (bi << 16) | (gi << 8) | ri;
-
-			for (int sx = -1; sx <= 2; ++sx) {
-				for (int sy = -1; sy <= 2; ++sy) {
-					// clamp pixel locations
-					int csy = clamp(sx - sy + 1 + y, 0, f*h - 1);
-					int csx = clamp(sx + sy - 1 + x, 0, f*w - 1);
-					// sample & add weighted components
-					u32 sample = out[csy*outw + csx];
-					r[sx + 1][sy + 1] = (float)R(sample);
-					g[sx + 1][sy + 1] = (float)G(sample);
-					b[sx + 1][sy + 1] = (float)B(sample);
-					a[sx + 1][sy + 1] = (float)A(sample);
-					Y[sx + 1][sy + 1] = (float)(0.2126*r[sx + 1][sy + 1] + 0.7152*g[sx + 1][sy + 1] + 0.0722*b[sx + 1][sy + 1]);
-				}
-			}
-			d_edge = diagonal_edge(Y, &wp[0]);
-			r1 = (float)w3*(r[0][3] + r[3][0]) + (float)w4*(r[1][2] + r[2][1]);
-			g1 = (float)w3*(g[0][3] + g[3][0]) + (float)w4*(g[1][2] + g[2][1]);
-			b1 = (float)w3*(b[0][3] + b[3][0]) + (float)w4*(b[1][2] + b[2][1]);
-			a1 = (float)w3*(a[0][3] + a[3][0]) + (float)w4*(a[1][2] + a[2][1]);
-			r2 = (float)w3*(r[0][0] + r[3][3]) + (float)w4*(r[1][1] + r[2][2]);
-			g2 = (float)w3*(g[0][0] + g[3][3]) + (float)w4*(g[1][1] + g[2][2]);
-			b2 = (float)w3*(b[0][0] + b[3][3]) + (float)w4*(b[1][1] + b[2][2]);
-			a2 = (float)w3*(a[0][0] + a[3][3]) + (float)w4*(a[1][1] + a[2][2]);
-			// generate and write result
-			if (d_edge <= 0.0f) { rf = r1; gf = g1; bf = b1; af = a1; }
-			else { rf = r2; gf = g2; bf = b2; af = a2; }
-			// anti-ringing, clamp.
-			rf = clamp(rf, min_r_sample, max_r_sample);
-			gf = clamp(gf, min_g_sample, max_g_sample);
-			bf = clamp(bf, min_b_sample, max_b_sample);
-			af = clamp(af, min_a_sample, max_a_sample);
-			ri = clamp(static_cast<int>(ceilf(rf)), 0, 255);
-			gi = clamp(static_cast<int>(ceilf(gf)), 0, 255);
-			bi = clamp(static_cast<int>(ceilf(bf)), 0, 255);
-			ai = clamp(static_cast<int>(ceilf(af)), 0, 255);
-			out[(y+1)*outw + x] = (ai << 24) | (bi << 16) | (gi << 8) | ri;
-			++x;
+	u32 c0 = rng[1][1], c1 = rng[2][1], c2 = rng[1][2], c3 = rng[2][2];
+	float min_r_sample = min4((float)R(c0), (float)R(c1), (float)R(c2), (float)R(c3));
+	float min_g_sample = min4((float)G(c0), (float)G(c1), (float)G(c2), (float)G(c3));
+	float min_b_sample = min4((float)B(c0), (float)B(c1), (float)B(c2), (float)B(c3));
+	float max_r_sample = max4((float)R(c0), (float)R(c1), (float)R(c2), (float)R(c3));
+	float max_g_sample = max4((float)G(c0), (float)G(c1), (float)G(c2), (float)G(c3));
+	float max_b_sample = max4((float)B(c0), (float)B(c1), (float)B(c2), (float)B(c3));
+	float d_edge = diagonal_edge<W0, W1, W2, W3, W4, W5>(Y);
+	float r1, g1, b1, r2, g2, b2, rf, gf, bf;
+	r1 = wa*(r[0][3] + r[3][0]) + wb*(r[1][2] + r[2][1]);
+	g1 = wa*(g[0][3] + g[3][0]) + wb*(g[1][2] + g[2][1]);
+	b1 = wa*(b[0][3] + b[3][0]) + wb*(b[1][2] + b[2][1]);
+	r2 = wa*(r[0][0] + r[3][3]) + wb*(r[1][1] + r[2][2]);
+	g2 = wa*(g[0][0] + g[3][3]) + wb*(g[1][1] + g[2][2]);
+	b2 = wa*(b[0][0] + b[3][3]) + wb*(b[1][1] + b[2][2]);
+	// generate and write result
+	if (d_edge <= 0.0f) { rf = r1; gf = g1; bf = b1; }
+	else { rf = r2; gf = g2; bf = b2; }
+	// anti-ringing, clamp.
+	rf = clamp(rf, min_r_sample, max_r_sample);
+	gf = clamp(gf, min_g_sample, max_g_sample);
+	bf = clamp(bf, min_b_sample, max_b_sample);
+	int ri = clamp(static_cast<int>(ceilf(rf)), 0, 255);
+	int gi = clamp(static_cast<int>(ceilf(gf)), 0, 255);
+	int bi = clamp(static_cast<int>(ceilf(bf)), 0, 255);
+	int ai = 255;
+	if (!opaque) {
+		float min_a_sample = min4((float)A(c0), (float)A(c1), (float)A(c2), (float)A(c3));
+		float max_a_sample = max4((float)A(c0), (float)A(c1), (float)A(c2), (float)A(c3));
+		float a1 = wa*(a[0][3] + a[3][0]) + wb*(a[1][2] + a[2][1]);
+		float a2 = wa*(a[0][0] + a[3][3]) + wb*(a[1][1] + a[2][2]);
+		float af = clamp(d_edge <= 0.0f ? a1 : a2, min_a_sample, max_a_sample);
+		ai = clamp(static_cast<int>(ceilf(af)), 0, 255);
+	}
+	return (ai << 24) | (bi << 16) | (gi << 8) | ri;
+}
+
+// Optional memo cache for the filter. Limited-palette art repeats the
+// same windows thousands of times, so the result computed for a window is
+// kept in a direct-mapped table keyed by its packed pixels (plus the
+// central samples of the range window, where that differs). A colliding
+// window simply replaces the entry, which keeps the table bounded. Each
+// thread has its own tables, so no locking is needed.
+const int MEMO_BITS = 10;
+
+template<int N>
+struct WindowMemo {
+	struct Entry {
+		u32 key[N];
+		u32 value;
+		bool valid;
+	};
+	std::vector<Entry> table;
+	long lookups = 0, hits = 0;
+
+	WindowMemo() : table(1 << MEMO_BITS) {}
+
+	Entry& slot(const u32* key) {
+		// independent per pixel, so that the multiplies can overlap
+		u32 hash = 0;
+		for (int i = 0; i < N; ++i) {
+			u32 k = key[i] * 0x9E3779B1u;
+			hash ^= (k << (i % 31)) | (k >> (32 - i % 31) % 32);
 		}
-		++y;
+		hash *= 0x85EBCA6Bu;
+		return table[hash >> (32 - MEMO_BITS)];
 	}
+};
 
-	// Third Pass
-	wp[0] =  2.0f;
-	wp[1] =  1.0f;
-	wp[2] = -1.0f;
-	wp[3] =  4.0f;
-	wp[4] = -1.0f;
-	wp[5] =  1.0f;
-
-	for (int y = outh - 1; y >= 0; --y) {
-		for (int x = outw - 1; x >= 0; --x) {
-			float r[4][4], g[4][4], b[4][4], a[4][4], Y[4][4];
-			for (int sx = -2; sx <= 1; ++sx) {
-				for (int sy = -2; sy <= 1; ++sy) {
-					// clamp pixel locations
-					int csy = clamp(sy + y, 0, f*h - 1);
-					int csx = clamp(sx + x, 0, f*w - 1);
-					// sample & add weighted components
-					u32 sample = out[csy*outw + csx];
-					r[sx + 2][sy + 2] = (float)R(sample);
-					g[sx + 2][sy + 2] = (float)G(sample);
-					b[sx + 2][sy + 2] = (float)B(sample);
-					a[sx + 2][sy + 2] = (float)A(sample);
-					Y[sx + 2][sy + 2] = (float)(0.2126*r[sx + 2][sy + 2] + 0.7152*g[sx + 2][sy + 2] + 0.0722*b[sx + 2][sy + 2]);
-				}
-			}
-			float min_r_sample = min4(r[1][1], r[2][1], r[1][2], r[2][2]);
-			float min_g_sample = min4(g[1][1], g[2][1], g[1][2], g[2][2]);
-			float min_b_sample = min4(b[1][1], b[2][1], b[1][2], b[2][2]);
-			float min_a_sample = min4(a[1][1], a[2][1], a[1][2], a[2][2]);
-			float max_r_sample = max4(r[1][1], r[2][1], r[1][2], r[2][2]);
-			float max_g_sample = max4(g[1][1], g[2][1], g[1][2], g[2][2]);
-			float max_b_sample = max4(b[1][1], b[2][1], b[1][2], b[2][2]);
-			float max_a_sample = max4(a[1][1], a[2][1], a[1][2], a[2][2]);
-			float d_edge = diagonal_edge(Y, &wp[0]);
-			float r1, g1, b1, a1, r2, g2, b2, a2, rf, gf, bf, af;
-			r1 = (float)w1*(r[0][3] + r[3][0]) + (float)w2*(r[1][2] + r[2][1]);
-			g1 = (float)w1*(g[0][3] + g[3][0]) + (float)w2*(g[1][2] + g[2][1]);
-			b1 = (float)w1*(b[0][3] + b[3][0]) + (float)w2*(b[1][2] + b[2][1]);
-			a1 = (float)w1*(a[0][3] + a[3][0]) + (float)w2*(a[1][2] + a[2][1]);
-			r2 = (float)w1*(r[0][0] + r[3][3]) + (float)w2*(r[1][1] + r[2][2]);
-			g2 = (float)w1*(g[0][0] + g[3][3]) + (float)w2*(g[1][1] + g[2][2]);
-			b2 = (float)w1*(b[0][0] + b[3][3]) + (float)w2*(b[1][1] + b[2][2]);
-			a2 = (float)w1*(a[0][0] + a[3][3]) + (float)w2*(a[1][1] + a[2][2]);
-			// generate and write result
-			if (d_edge <= 0.0f) { rf = r1; gf = g1; bf = b1; af = a1; }
-			else { rf = r2; gf = g2; bf = b2; af = a2; }
-			// anti-ringing, clamp.
-			rf = clamp(rf, min_r_sample, max_r_sample);
-			gf = clamp(gf, min_g_sample, max_g_sample);
-			bf = clamp(bf, min_b_sample, max_b_sample);
-			af = clamp(af, min_a_sample, max_a_sample);
-			int ri = clamp(static_cast<int>(ceilf(rf)), 0, 255);
-			int gi = clamp(static_cast<int>(ceilf(gf)), 0, 255);
-			int bi = clamp(static_cast<int>(ceilf(bf)), 0, 255);
-			int ai = clamp(static_cast<int>(ceilf(af)), 0, 255);
-			out[y*outw + x] = (ai << 24) | (bi << 16) | (gi << 8) | ri;
+struct SuperXBRMemo {
+	WindowMemo<16> pass1, pass2a, pass3;
+	WindowMemo<20> pass2b;
+};
+
+static bool memoEnabled = false;
+static long memoLookups[3] = { 0, 0, 0 };
+static long memoHits[3] = { 0, 0, 0 };
+
+void setSuperXBRMemo(bool on) {
+	memoEnabled = on;
+}
+
+void superXBRMemoStats(long lookups[3], long hits[3]) {
+	for (int p = 0; p < 3; ++p) {
+		lookups[p] = memoLookups[p];
+		hits[p] = memoHits[p];
+	}
+}
+
+// superXBRFilter() through the memo, if there is one.
+template<bool opaque, int W0, int W1, int W2, int W3, int W4, int W5, int N>
+u32 superXBRFilterMemo(WindowMemo<N>* memo, u32 win[][4], u32 rng[][4], float wa, float wb) {
+	if (!memo)
+		return superXBRFilter<opaque, W0, W1, W2, W3, W4, W5>(win, rng, wa, wb);
+
+	u32 key[N];
+	std::copy(&win[0][0], &win[0][0] + 16, key);
+	if (N > 16) {
+		key[16] = rng[1][1]; key[17] = rng[2][1];
+		key[18] = rng[1][2]; key[19] = rng[2][2];
+	}
+	typename WindowMemo<N>::Entry& entry = memo->slot(key);
+	++memo->lookups;
+	if (entry.valid && std::equal(key, key + N, entry.key)) {
+		++memo->hits;
+		return entry.value;
+	}
+	entry.value = superXBRFilter<opaque, W0, W1, W2, W3, W4, W5>(win, rng, wa, wb);
+	std::copy(key, key + N, entry.key);
+	entry.valid = true;
+	return entry.value;
+}
+
+// First pass: fills the 2x2 output block whose top left corner is (x, y).
+// Reads the input image only.
+template<int f, bool opaque>
+void superXBRPass1(u32* data, u32* out, int w, int h, int x, int y, SuperXBRMemo* memo) {
+	long outw = w*f;
+	int cx = x / f, cy = y / f; // central pixels on original images
+	u32 e = data[(long)cy*w + cx];
+	out[y*outw + x] = out[y*outw + x + 1] = out[(y + 1)*outw + x] = e;
+	if (uniform4(e, clamped_at(data, w, h, cx + 1, cy), clamped_at(data, w, h, cx, cy + 1), clamped_at(data, w, h, cx + 1, cy + 1))) {
+		out[(y + 1)*outw + x + 1] = e;
+		return;
+	}
+
+	u32 win[4][4];
+	// sample supporting pixels in original image
+	for (int sx = -1; sx <= 2; ++sx)
+		for (int sy = -1; sy <= 2; ++sy)
+			win[sx + 1][sy + 1] = clamped_at(data, w, h, sx + cx, sy + cy);
+	out[(y+1)*outw + x+1] = superXBRFilterMemo<opaque, 2, 1, -1, 4, -1, 1>(memo ? &memo->pass1 : nullptr, win, win, (float)w1, (float)w2);
+}
+
+// Second pass: fills the two pixels of the block at (x, y) that were
+// left as copies of the input by the first pass. Works in place on out.
+// Both pixels are clamped to the central samples of the first window.
+template<int f, bool opaque>
+void superXBRPass2(u32* out, int w, int h, int x, int y, SuperXBRMemo* memo) {
+	long outw = w*f, outh = h*f;
+	u32 e = out[y*outw + x];
+	if (uniform4(e, clamped_at(out, outw, outh, x + 1, y + 1), clamped_at(out, outw, outh, x + 1, y - 1), clamped_at(out, outw, outh, x + 2, y))) {
+		out[y*outw + x + 1] = out[(y + 1)*outw + x] = e;
+		return;
+	}
+
+	u32 win[4][4], win2[4][4];
+	// sample supporting pixels in original image
+	for (int sx = -1; sx <= 2; ++sx)
+		for (int sy = -1; sy <= 2; ++sy)
+			win[sx + 1][sy + 1] = clamped_at(out, outw, outh, sx + sy + x, sx - sy + y);
+	out[y*outw + x + 1] = superXBRFilterMemo<opaque, 2, 0, 0, 0, 0, 0>(memo ? &memo->pass2a : nullptr, win, win, (float)w3, (float)w4);
+
+	for (int sx = -1; sx <= 2; ++sx)
+		for (int sy = -1; sy <= 2; ++sy)
+			win2[sx + 1][sy + 1] = clamped_at(out, outw, outh, sx + sy - 1 + x, sx - sy + 1 + y);
+	out[(y+1)*outw + x] = superXBRFilterMemo<opaque, 2, 0, 0, 0, 0, 0>(memo ? &memo->pass2b : nullptr, win2, win, (float)w3, (float)w4);
+}
+
+// Third pass: recomputes the single pixel (x, y) in place.
+template<int f, bool opaque>
+void superXBRPass3(u32* out, int w, int h, int x, int y, SuperXBRMemo* memo) {
+	long outw = w*f, outh = h*f;
+	u32 e = out[y*outw + x];
+	if (uniform4(e, clamped_at(out, outw, outh, x - 1, y), clamped_at(out, outw, outh, x, y - 1), clamped_at(out, outw, outh, x - 1, y - 1)))
+		return;
+
+	u32 win[4][4];
+	for (int sx = -2; sx <= 1; ++sx)
+		for (int sy = -2; sy <= 1; ++sy)
+			win[sx + 2][sy + 2] = clamped_at(out, outw, outh, sx + x, sy + y);
+	out[y*outw + x] = superXBRFilterMemo<opaque, 2, 1, -1, 4, -1, 1>(memo ? &memo->pass3 : nullptr, win, win, (float)w1, (float)w2);
+}
+
+// Pass 2 reads back pixels it has written itself only where the clamped
+// window runs off the edge of the image, which happens within two blocks
+// of the border. Everywhere else it is a pure function of the pass 1
+// output, so the interior may run in any order, while the border is
+// replayed in the original raster order. The pass 1 blocks that the
+// border reads lie within four blocks of the edge.
+template<int f, bool opaque>
+void superXBRPass1Border(u32* data, u32* out, int w, int h, SuperXBRMemo* memo) {
+	for (int cy = 0; cy < h; ++cy) {
+		bool edge = cy < 4 || cy >= h - 4;
+		for (int cx = 0; cx < w; ++cx) {
+			if (!edge && cx == 4 && cx < w - 4)
+				cx = w - 4;
+			superXBRPass1<f, opaque>(data, out, w, h, f*cx, f*cy, memo);
+		}
+	}
+}
+
+template<int f, bool opaque>
+void superXBRPass1Interior(u32* data, u32* out, int w, int h, int cy, SuperXBRMemo* memo) {
+	if (cy < 4 || cy >= h - 4)
+		return;
+	for (int cx = 4; cx < w - 4; ++cx)
+		superXBRPass1<f, opaque>(data, out, w, h, f*cx, f*cy, memo);
+}
+
+template<int f, bool opaque>
+void superXBRPass2Border(u32* out, int w, int h, SuperXBRMemo* memo) {
+	for (int cy = 0; cy < h; ++cy) {
+		bool edge = cy < 2 || cy >= h - 2;
+		for (int cx = 0; cx < w; ++cx) {
+			if (!edge && cx == 2 && cx < w - 2)
+				cx = w - 2;
+			superXBRPass2<f, opaque>(out, w, h, f*cx, f*cy, memo);
 		}
 	}
+}
+
+template<int f, bool opaque>
+void superXBRPass2Interior(u32* out, int w, int h, int cy, SuperXBRMemo* memo) {
+	if (cy < 2 || cy >= h - 2)
+		return;
+	for (int cx = 2; cx < w - 2; ++cx)
+		superXBRPass2<f, opaque>(out, w, h, f*cx, f*cy, memo);
+}
+
+// Pass 3 runs bottom-up and right-to-left, and every pixel depends on the
+// already rewritten pixels below and to its right. A thread therefore
+// takes one pair of rows at a time and trails the pair below it: column x
+// may be processed once the pair below has finished all columns from x-2
+// on. done[k] is the leftmost finished column of the upper row of pair k.
+const int WAVEFRONT_CHUNK = 64;
+
+template<int f, bool opaque>
+void superXBRPass3Pair(u32* out, int w, int h, int k, std::atomic<int>* done, SuperXBRMemo* memo) {
+	int outw = w*f;
+	int y = f*k;
+	int bottom = outw, top = outw;
+
+	while (top > 0) {
+		int next = std::max(bottom - WAVEFRONT_CHUNK, 0);
+		if (k + 1 < h) {
+			while (done[k + 1].load(std::memory_order_acquire) > std::max(next - 2, 0))
+				std::this_thread::yield();
+		}
+		for (int x = bottom - 1; x >= next; --x)
+			superXBRPass3<f, opaque>(out, w, h, x, y + 1, memo);
+		bottom = next;
+
+		int stop = bottom > 0 ? bottom + 2 : 0;
+		for (int x = top - 1; x >= stop; --x)
+			superXBRPass3<f, opaque>(out, w, h, x, y, memo);
+		top = std::min(top, stop);
+		done[k].store(top, std::memory_order_release);
+	}
+}
+
+// Waits until all block rows k0..k1 that exist have completed `level` passes.
+void superXBRWait(std::atomic<int>* stage, int h, int k0, int k1, int level) {
+	for (int k = std::max(k0, 0); k <= std::min(k1, h - 1); ++k)
+		while (stage[k].load(std::memory_order_acquire) < level)
+			std::this_thread::yield();
+}
+
+// The fast preset stops after pass 2. Pass 3 is the most expensive of the
+// three, since it visits every output pixel rather than one in four or
+// two in four, and it only touches up the edges the first two passes
+// have already placed.
+static bool fastPreset = false;
+
+void setSuperXBRFast(bool on) {
+	fastPreset = on;
+}
+
+// The passes are fused into a single bottom-up sweep over the rows of 2x2
+// blocks, so that passes 2 and 3 pick up rows that pass 1 produced only a
+// few steps earlier and that are still in cache, instead of streaming the
+// whole output three times. Step s runs pass 1 on block row s, pass 2 on
+// block row s+2 and pass 3 on block row s+4, the shortest lags the 4x4
+// windows allow. The border is done up front.
+//
+// Steps are dealt out to the threads round-robin. stage[k] counts the
+// passes finished on block row k, and each step waits for the rows its
+// windows read (or that its pass 3 writes are still read by). The output
+// is identical to running the three passes serially, for any number of
+// threads.
+template<int f, bool opaque>
+void scaleSuperXBRT(u32* data, u32* out, int w, int h) {
+	// one memo per thread, if enabled; the border runs on thread 0
+	std::vector<SuperXBRMemo> memos(memoEnabled ? threadCount() : 0);
+	SuperXBRMemo* memo0 = memos.empty() ? nullptr : &memos[0];
+
+	superXBRPass1Border<f, opaque>(data, out, w, h, memo0);
+	superXBRPass2Border<f, opaque>(out, w, h, memo0);
+
+	std::vector<std::atomic<int>> stage(h), done(h);
+	for (int k = 0; k < h; ++k) {
+		stage[k].store(0);
+		done[k].store(w*f);
+	}
+
+	bool full = !fastPreset;
+	parallelRun([&](int t, int n) {
+		SuperXBRMemo* memo = memos.empty() ? nullptr : &memos[t];
+		for (int s = h - 1 - t; s >= (full ? -4 : -2); s -= n) {
+			if (s >= 0) {
+				superXBRPass1Interior<f, opaque>(data, out, w, h, s, memo);
+				stage[s].store(1, std::memory_order_release);
+			}
 
+			int k = s + 2;
+			if (k >= 0 && k < h) {
+				superXBRWait(stage.data(), h, k - 2, k + 2, 1);
+				superXBRPass2Interior<f, opaque>(out, w, h, k, memo);
+				stage[k].store(2, std::memory_order_release);
+			}
+
+			k = s + 4;
+			if (full && k >= 0 && k < h) {
+				superXBRWait(stage.data(), h, k - 2, k + 1, 2);
+				superXBRPass3Pair<f, opaque>(out, w, h, k, done.data(), memo);
+			}
+		}
+	});
+
+	for (SuperXBRMemo& m : memos) {
+		memoLookups[0] += m.pass1.lookups;
+		memoHits[0] += m.pass1.hits;
+		memoLookups[1] += m.pass2a.lookups + m.pass2b.lookups;
+		memoHits[1] += m.pass2a.hits + m.pass2b.hits;
+		memoLookups[2] += m.pass3.lookups;
+		memoHits[2] += m.pass3.hits;
+	}
 }
 
 //// *** Super-xBR code ends here - MIT LICENSE *** ///
@@ -373,5 +529,304 @@ void scaleSuperXBR(u32* data, int w, int h, u32* out) {
 // void scaleSuperXBR(int factor, u32* data, u32* out, int w, int h) {
   
         /* Super-xBR upsampling only implemented for factor 2 */
-        scaleSuperXBRT<2>(data, out, w, h);
+        if (isOpaque(data, (long)w*h))
+                scaleSuperXBRT<2, true>(data, out, w, h);
+        else
+                scaleSuperXBRT<2, false>(data, out, w, h);
+}
+
+// Higher factors apply the 2x kernel repeatedly, in memory. The stages
+// alternate between out and a single scratch buffer, arranged so that the
+// last stage writes to out; earlier stages that land in out use only its
+// beginning, which the last stage overwrites. The scratch buffer thus holds
+// at most a quarter of the output.
+void scaleSuperXBRChain(u32* data, int w, int h, u32* out, int stages) {
+        u32* tmp = 0;
+        if (stages > 1) {
+                long n = (long)w*h << 2*(stages - 1);
+                tmp = new u32[n];
+        }
+
+        // every stage keeps an opaque image opaque
+        bool opaque = isOpaque(data, (long)w*h);
+        u32* src = data;
+        for (int i = 0; i < stages; ++i) {
+                u32* dst = (stages - i) % 2 ? out : tmp;
+                if (opaque)
+                        scaleSuperXBRT<2, true>(src, dst, w, h);
+                else
+                        scaleSuperXBRT<2, false>(src, dst, w, h);
+                src = dst;
+                w *= 2;
+                h *= 2;
+        }
+
+        delete[] tmp;
+}
+
+void scaleSuperXBR4x(u32* data, int w, int h, u32* out) {
+        scaleSuperXBRChain(data, w, h, out, 2);
+}
+
+void scaleSuperXBR8x(u32* data, int w, int h, u32* out) {
+        scaleSuperXBRChain(data, w, h, out, 3);
+}
+
+///////////////////////// xBR scaling
+// Integer, single-pass xBR (levels 2 and 3) by Hyllian, after the C
+// version in FFmpeg's vf_xbr filter. Requires 2px padding on all four sides.
+//
+// Every input pixel E becomes an n x n block, initially all E. The four
+// corners of the block are then treated in turn by the same rules: the
+// window around E (5x5 without its corners) is rotated so that the corner
+// at hand is the bottom right one, and if an edge runs across that corner
+// the pixels next to it are blended toward the color across the edge.
+//
+// Level 2 knows edges at 45 degrees and at a slope of 1:2; level 3 adds a
+// slope of 1:3. All of them pivot on the middle of the far side of the
+// corner, and a pixel of the block is blended by about the share of it
+// that lies across the line (FFmpeg's level 2 tables follow the same
+// geometry).
+
+// Pixels are 0xAARRGGBB. Returns 0x00YYUUVV.
+static u32 xbrYUV(u32 c) {
+	int r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+	u32 y = (299*r + 587*g + 114*b) / 1000;
+	u32 u = (-169*r - 331*g + 500*b) / 1000 + 128;
+	u32 v = (500*r - 419*g - 81*b) / 1000 + 128;
+	return (y << 16) | (u << 8) | v;
+}
+
+// Color distance between two YUV values.
+static inline int xbrDiff(u32 a, u32 b) {
+	return std::abs((int)(a >> 16) - (int)(b >> 16)) +
+		std::abs((int)((a >> 8) & 0xFF) - (int)((b >> 8) & 0xFF)) +
+		std::abs((int)(a & 0xFF) - (int)(b & 0xFF));
+}
+
+// a + m/2^s * (b - a), per channel. Red/blue and green/alpha are done two
+// at a time, with 16 bits per channel, so the products cannot overflow.
+template<int m, int s>
+inline u32 xbrBlend(u32 a, u32 b) {
+	const u32 mask = 0x00FF00FF;
+	u32 rb = (a & mask) + ((((b & mask) - (a & mask)) * m) >> s);
+	u32 ga = ((a >> 8) & mask) + (((((b >> 8) & mask) - ((a >> 8) & mask)) * m) >> s);
+	return (rb & mask) | ((ga & mask) << 8);
+}
+
+// Halfway, the original averages the color bytes with their low bits
+// dropped. Alpha is averaged exactly, so that opaque stays opaque.
+template<>
+inline u32 xbrBlend<1, 1>(u32 a, u32 b) {
+	return ((a & 0x00FEFEFE) >> 1) + ((b & 0x00FEFEFE) >> 1) +
+		((((a >> 24) + (b >> 24)) >> 1) << 24);
+}
+
+// Offset of pixel (dx, dy) from the center, in the window rotated by rot
+// quarter turns counterclockwise.
+template<int rot>
+inline int xbrOffset(int dx, int dy, int stride) {
+	switch (rot) {
+	case 0: return dy*stride + dx;
+	case 1: return -dx*stride + dy;
+	case 2: return -dy*stride - dx;
+	default: return dx*stride - dy;
+	}
+}
+
+// Handles one corner of the n x n block E. p and q point to the center
+// pixel and its YUV value.
+template<int n, int lv, int rot>
+inline void xbrCorner(const u32* p, const u32* q, int stride, u32* E) {
+	auto P = [&](int dx, int dy) { return p[xbrOffset<rot>(dx, dy, stride)]; };
+	auto Q = [&](int dx, int dy) { return q[xbrOffset<rot>(dx, dy, stride)]; };
+	// element (r, c) of the block, in the rotated frame
+	auto at = [&](int r, int c) -> u32& {
+		switch (rot) {
+		case 0: return E[r*n + c];
+		case 1: return E[(n - 1 - c)*n + r];
+		case 2: return E[(n - 1 - r)*n + n - 1 - c];
+		default: return E[c*n + n - 1 - r];
+		}
+	};
+
+	u32 PE = P(0, 0), PF = P(1, 0), PH = P(0, 1);
+	if (PE == PH || PE == PF)
+		return;
+
+	u32 pe = Q(0, 0), pf = Q(1, 0), ph = Q(0, 1), pi = Q(1, 1);
+	u32 pg = Q(-1, 1), pc = Q(1, -1), pd = Q(-1, 0), pb = Q(0, -1);
+	u32 f4 = Q(2, 0), i4 = Q(2, 1), h5 = Q(0, 2), i5 = Q(1, 2);
+
+	int e = xbrDiff(pe, pc) + xbrDiff(pe, pg) + xbrDiff(pi, h5) + xbrDiff(pi, f4) + (xbrDiff(ph, pf) << 2);
+	int i = xbrDiff(ph, pd) + xbrDiff(ph, i5) + xbrDiff(pf, i4) + xbrDiff(pf, pb) + (xbrDiff(pe, pi) << 2);
+	if (e > i)
+		return;
+
+	auto eq = [](u32 a, u32 b) { return xbrDiff(a, b) < 155; };
+	u32 px = xbrDiff(pe, pf) <= xbrDiff(pe, ph) ? PF : PH;
+	u32& corner = at(n - 1, n - 1);
+
+	// 3x and 4x interpolate on a broader rule than 2x, as in the original
+	bool edge = n == 2 ?
+		(!eq(pf, pb) && !eq(ph, pd)) || (eq(pe, pi) && !eq(pf, i4) && !eq(ph, i5)) ||
+		eq(pe, pg) || eq(pe, pc) :
+		(!eq(pf, pb) && !eq(pf, pc)) || (!eq(ph, pd) && !eq(ph, pg)) ||
+		(eq(pe, pi) && ((!eq(pf, f4) && !eq(pf, i4)) || (!eq(ph, h5) && !eq(ph, i5)))) ||
+		eq(pe, pg) || eq(pe, pc);
+	if (!(e < i && edge)) {
+		corner = xbrBlend<1, 1>(corner, px);
+		return;
+	}
+
+	int ke = xbrDiff(pf, pg), ki = xbrDiff(ph, pc);
+	bool left = (ke << 1) <= ki && PE != P(-1, 1) && P(-1, 0) != P(-1, 1);
+	bool up = ke >= (ki << 1) && PE != P(1, -1) && P(0, -1) != P(1, -1);
+	// level 3: the color across a shallow edge goes on one pixel further,
+	// and the pixel beyond it is on this side again
+	bool left3 = lv == 3 && left && !up &&
+		P(-2, 1) == P(-1, 1) && P(-2, 0) != P(-2, 1);
+	bool up3 = lv == 3 && up && !left &&
+		P(1, -2) == P(1, -1) && P(0, -2) != P(1, -2);
+
+	if (n == 2) {
+		if (left && up) {
+			corner = xbrBlend<7, 3>(corner, px);
+			at(1, 0) = at(0, 1) = xbrBlend<1, 2>(at(1, 0), px);
+		} else if (left3) {
+			corner = xbrBlend<7, 3>(corner, px);
+			at(1, 0) = xbrBlend<1, 1>(at(1, 0), px);
+		} else if (up3) {
+			corner = xbrBlend<7, 3>(corner, px);
+			at(0, 1) = xbrBlend<1, 1>(at(0, 1), px);
+		} else if (left) {
+			corner = xbrBlend<3, 2>(corner, px);
+			at(1, 0) = xbrBlend<1, 2>(at(1, 0), px);
+		} else if (up) {
+			corner = xbrBlend<3, 2>(corner, px);
+			at(0, 1) = xbrBlend<1, 2>(at(0, 1), px);
+		} else {
+			corner = xbrBlend<1, 1>(corner, px);
+		}
+	} else if (n == 3) {
+		if (left && up) {
+			at(2, 1) = at(1, 2) = xbrBlend<3, 2>(at(2, 1), px);
+			at(2, 0) = at(0, 2) = xbrBlend<1, 2>(at(2, 0), px);
+			corner = px;
+		} else if (left3) {
+			at(2, 0) = xbrBlend<3, 2>(at(2, 0), px);
+			at(1, 2) = xbrBlend<1, 2>(at(1, 2), px);
+			corner = at(2, 1) = px;
+		} else if (up3) {
+			at(0, 2) = xbrBlend<3, 2>(at(0, 2), px);
+			at(2, 1) = xbrBlend<1, 2>(at(2, 1), px);
+			corner = at(1, 2) = px;
+		} else if (left) {
+			at(2, 1) = xbrBlend<3, 2>(at(2, 1), px);
+			at(1, 2) = xbrBlend<1, 2>(at(1, 2), px);
+			at(2, 0) = xbrBlend<1, 2>(at(2, 0), px);
+			corner = px;
+		} else if (up) {
+			at(1, 2) = xbrBlend<3, 2>(at(1, 2), px);
+			at(2, 1) = xbrBlend<1, 2>(at(2, 1), px);
+			at(0, 2) = xbrBlend<1, 2>(at(0, 2), px);
+			corner = px;
+		} else {
+			corner = xbrBlend<7, 3>(corner, px);
+			at(1, 2) = xbrBlend<1, 3>(at(1, 2), px);
+			at(2, 1) = xbrBlend<1, 3>(at(2, 1), px);
+		}
+	} else {
+		if (left && up) {
+			at(3, 1) = at(1, 3) = xbrBlend<3, 2>(at(3, 1), px);
+			at(3, 0) = at(2, 2) = at(0, 3) = xbrBlend<1, 2>(at(3, 0), px);
+			corner = at(3, 2) = at(2, 3) = px;
+		} else if (left3) {
+			at(3, 0) = xbrBlend<7, 3>(at(3, 0), px);
+			at(2, 3) = xbrBlend<7, 3>(at(2, 3), px);
+			at(2, 2) = xbrBlend<1, 1>(at(2, 2), px);
+			at(2, 1) = xbrBlend<1, 3>(at(2, 1), px);
+			corner = at(3, 2) = at(3, 1) = px;
+		} else if (up3) {
+			at(0, 3) = xbrBlend<7, 3>(at(0, 3), px);
+			at(3, 2) = xbrBlend<7, 3>(at(3, 2), px);
+			at(2, 2) = xbrBlend<1, 1>(at(2, 2), px);
+			at(1, 2) = xbrBlend<1, 3>(at(1, 2), px);
+			corner = at(2, 3) = at(1, 3) = px;
+		} else if (left) {
+			at(2, 3) = xbrBlend<3, 2>(at(2, 3), px);
+			at(3, 1) = xbrBlend<3, 2>(at(3, 1), px);
+			at(2, 2) = xbrBlend<1, 2>(at(2, 2), px);
+			at(3, 0) = xbrBlend<1, 2>(at(3, 0), px);
+			corner = at(3, 2) = px;
+		} else if (up) {
+			at(3, 2) = xbrBlend<3, 2>(at(3, 2), px);
+			at(1, 3) = xbrBlend<3, 2>(at(1, 3), px);
+			at(2, 2) = xbrBlend<1, 2>(at(2, 2), px);
+			at(0, 3) = xbrBlend<1, 2>(at(0, 3), px);
+			corner = at(2, 3) = px;
+		} else {
+			at(2, 3) = xbrBlend<1, 1>(at(2, 3), px);
+			at(3, 2) = xbrBlend<1, 1>(at(3, 2), px);
+			corner = px;
+		}
+	}
+}
+
+// Rows are independent, so they are split among the threads.
+template<int n, int lv>
+void scaleXBR(u32* img, int w, int h, u32* out) {
+	const int pad = 2;
+	int V = w + 2*pad;
+
+	std::vector<u32> yuv((long)V*(h + 2*pad));
+	for (long k = 0; k < (long)yuv.size(); ++k)
+		yuv[k] = xbrYUV(img[k]);
+
+	parallelBands(0, h, [&](int y0, int y1) {
+		for (int y = y0; y < y1; ++y) {
+			const u32* p = img + (long)(y + pad)*V + pad;
+			const u32* q = yuv.data() + (long)(y + pad)*V + pad;
+			u32* dst = out + (long)y*n*n*w;
+
+			for (int x = 0; x < w; ++x) {
+				u32 E[n*n];
+				std::fill(E, E + n*n, p[x]);
+				xbrCorner<n, lv, 0>(p + x, q + x, V, E);
+				xbrCorner<n, lv, 1>(p + x, q + x, V, E);
+				xbrCorner<n, lv, 2>(p + x, q + x, V, E);
+				xbrCorner<n, lv, 3>(p + x, q + x, V, E);
+
+				for (int r = 0; r < n; ++r)
+					std::copy(E + r*n, E + (r + 1)*n, dst + (long)r*n*w + n*x);
+			}
+		}
+	});
+}
+
+static int xbrLevel = 2;
+
+void setXBRLevel(int level) {
+	xbrLevel = level;
+}
+
+void scaleXBR2x(u32* data, int w, int h, u32* out) {
+	if (xbrLevel == 3)
+		scaleXBR<2, 3>(data, w, h, out);
+	else
+		scaleXBR<2, 2>(data, w, h, out);
+}
+
+void scaleXBR3x(u32* data, int w, int h, u32* out) {
+	if (xbrLevel == 3)
+		scaleXBR<3, 3>(data, w, h, out);
+	else
+		scaleXBR<3, 2>(data, w, h, out);
+}
+
+void scaleXBR4x(u32* data, int w, int h, u32* out) {
+	if (xbrLevel == 3)
+		scaleXBR<4, 3>(data, w, h, out);
+	else
+		scaleXBR<4, 2>(data, w, h, out);
 }
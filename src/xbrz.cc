@@ -0,0 +1,502 @@
+/*
+
+xBRZ: "Scale by rules" - high quality image upscaling filter by Zenju.
+Copyright (C) Zenju. Licensed under the GNU General Public License,
+version 3 or later: https://www.gnu.org/licenses/gpl-3.0.html
+
+Adapted from
+    https://sourceforge.net/projects/xbrz/
+for the pixelscaler driver: padded input instead of clamped reads,
+distances in float, and a separate blend buffer for every slice of rows.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "xbrz.h"
+#include "parallel.h"
+#include "bitmap.h"
+
+typedef uint32_t u32;
+
+const float luminanceWeight            = 1.0f;
+const float equalColorTolerance        = 30.0f;
+const float dominantDirectionThreshold = 3.6f;
+const float steepDirectionThreshold    = 2.2f;
+
+enum BlendType { BLEND_NONE = 0, BLEND_NORMAL = 1, BLEND_DOMINANT = 2 };
+
+// The blend info of a pixel holds a BlendType for each of its corners.
+inline int getTopL   (unsigned char b) { return b & 0x3; }
+inline int getTopR   (unsigned char b) { return (b >> 2) & 0x3; }
+inline int getBottomR(unsigned char b) { return (b >> 4) & 0x3; }
+inline int getBottomL(unsigned char b) { return (b >> 6) & 0x3; }
+
+inline void setTopL   (unsigned char& b, int bt) { b |= bt; }
+inline void setTopR   (unsigned char& b, int bt) { b |= bt << 2; }
+inline void setBottomR(unsigned char& b, int bt) { b |= bt << 4; }
+inline void setBottomL(unsigned char& b, int bt) { b |= bt << 6; }
+
+// Every corner is handled by the same code, in a frame rotated by rot
+// quarter turns so that the corner at hand is the bottom right one.
+template<int rot>
+inline unsigned char rotateBlendInfo(unsigned char b) {
+	return rot == 0 ? b : (unsigned char)((b << 2*rot) | (b >> (8 - 2*rot)));
+}
+
+// Offset of the pixel at (dx, dy) in the rotated frame.
+template<int rot>
+inline long rotatedOffset(int dx, int dy, long stride) {
+	switch (rot) {
+	case 0: return dy*stride + dx;
+	case 1: return -dx*stride + dy;
+	case 2: return -dy*stride - dx;
+	default: return dx*stride - dy;
+	}
+}
+
+// The n x n output block of a pixel, in the rotated frame.
+template<int n, int rot, bool opq>
+struct OutputMatrix {
+	static const bool opaque = opq;
+	u32* out;
+	long stride;
+
+	OutputMatrix(u32* out, long stride) : out(out), stride(stride) {}
+
+	u32& ref(int i, int j) {
+		switch (rot) {
+		case 0: return out[i*stride + j];
+		case 1: return out[(n - 1 - j)*stride + i];
+		case 2: return out[(n - 1 - i)*stride + n - 1 - j];
+		default: return out[j*stride + n - 1 - i];
+		}
+	}
+};
+
+// YCbCr distance (ITU-R BT.2020). A transparent pixel is close to any
+// other transparent one, whatever its color.
+template<bool opaque>
+inline float dist(u32 pix1, u32 pix2) {
+	int rd = (int)((pix1 >> 16) & 0xFF) - (int)((pix2 >> 16) & 0xFF);
+	int gd = (int)((pix1 >>  8) & 0xFF) - (int)((pix2 >>  8) & 0xFF);
+	int bd = (int)( pix1        & 0xFF) - (int)( pix2        & 0xFF);
+
+	const float kb = 0.0593f, kr = 0.2627f, kg = 1 - kb - kr;
+	const float scaleB = 0.5f / (1 - kb), scaleR = 0.5f / (1 - kr);
+	float y  = kr*rd + kg*gd + kb*bd;
+	float cb = scaleB*(bd - y);
+	float cr = scaleR*(rd - y);
+	float d = std::sqrt(luminanceWeight*y*luminanceWeight*y + cb*cb + cr*cr);
+	if (opaque)
+		return d;
+
+	float a1 = (pix1 >> 24) / 255.0f, a2 = (pix2 >> 24) / 255.0f;
+	return a1 < a2 ? a1*d + 255*(a2 - a1) : a2*d + 255*(a1 - a2);
+}
+
+// Blends front into back with weight M/N, alpha-weighted.
+template<unsigned M, unsigned N, bool opaque>
+inline void alphaGrad(u32& back, u32 front) {
+	if (opaque) {
+		auto mix = [&](int s) { return ((((front >> s) & 0xFF)*M + ((back >> s) & 0xFF)*(N - M)) / N) << s; };
+		back = 0xFF000000 | mix(16) | mix(8) | mix(0);
+		return;
+	}
+
+	unsigned wf = (front >> 24)*M, wb = (back >> 24)*(N - M), ws = wf + wb;
+	if (ws == 0) {
+		back = 0;
+		return;
+	}
+	auto mix = [&](int s) { return ((((front >> s) & 0xFF)*wf + ((back >> s) & 0xFF)*wb) / ws) << s; };
+	back = ((ws / N) << 24) | mix(16) | mix(8) | mix(0);
+}
+
+template<unsigned M, unsigned N, class Out>
+inline void grad(Out& out, int i, int j, u32 col) {
+	alphaGrad<M, N, Out::opaque>(out.ref(i, j), col);
+}
+
+// The blend patterns for the bottom right corner, one struct per factor.
+struct Scaler2x {
+	static const int scale = 2;
+
+	template<class Out> static void blendLineShallow(u32 col, Out& out) {
+		grad<1, 4>(out, 1, 0, col);
+		grad<3, 4>(out, 1, 1, col);
+	}
+	template<class Out> static void blendLineSteep(u32 col, Out& out) {
+		grad<1, 4>(out, 0, 1, col);
+		grad<3, 4>(out, 1, 1, col);
+	}
+	template<class Out> static void blendLineSteepAndShallow(u32 col, Out& out) {
+		grad<1, 4>(out, 1, 0, col);
+		grad<1, 4>(out, 0, 1, col);
+		grad<5, 6>(out, 1, 1, col);
+	}
+	template<class Out> static void blendLineDiagonal(u32 col, Out& out) {
+		grad<1, 2>(out, 1, 1, col);
+	}
+	template<class Out> static void blendCorner(u32 col, Out& out) {
+		grad<21, 100>(out, 1, 1, col); // 1 - pi/4
+	}
+};
+
+struct Scaler3x {
+	static const int scale = 3;
+
+	template<class Out> static void blendLineShallow(u32 col, Out& out) {
+		grad<1, 4>(out, 2, 0, col);
+		grad<1, 4>(out, 1, 2, col);
+		grad<3, 4>(out, 2, 1, col);
+		out.ref(2, 2) = col;
+	}
+	template<class Out> static void blendLineSteep(u32 col, Out& out) {
+		grad<1, 4>(out, 0, 2, col);
+		grad<1, 4>(out, 2, 1, col);
+		grad<3, 4>(out, 1, 2, col);
+		out.ref(2, 2) = col;
+	}
+	template<class Out> static void blendLineSteepAndShallow(u32 col, Out& out) {
+		grad<1, 4>(out, 2, 0, col);
+		grad<1, 4>(out, 0, 2, col);
+		grad<3, 4>(out, 2, 1, col);
+		grad<3, 4>(out, 1, 2, col);
+		out.ref(2, 2) = col;
+	}
+	template<class Out> static void blendLineDiagonal(u32 col, Out& out) {
+		grad<1, 8>(out, 1, 2, col);
+		grad<1, 8>(out, 2, 1, col);
+		grad<7, 8>(out, 2, 2, col);
+	}
+	template<class Out> static void blendCorner(u32 col, Out& out) {
+		grad<45, 100>(out, 2, 2, col);
+	}
+};
+
+struct Scaler4x {
+	static const int scale = 4;
+
+	template<class Out> static void blendLineShallow(u32 col, Out& out) {
+		grad<1, 4>(out, 3, 0, col);
+		grad<1, 4>(out, 2, 2, col);
+		grad<3, 4>(out, 3, 1, col);
+		grad<3, 4>(out, 2, 3, col);
+		out.ref(3, 2) = col;
+		out.ref(3, 3) = col;
+	}
+	template<class Out> static void blendLineSteep(u32 col, Out& out) {
+		grad<1, 4>(out, 0, 3, col);
+		grad<1, 4>(out, 2, 2, col);
+		grad<3, 4>(out, 1, 3, col);
+		grad<3, 4>(out, 3, 2, col);
+		out.ref(2, 3) = col;
+		out.ref(3, 3) = col;
+	}
+	template<class Out> static void blendLineSteepAndShallow(u32 col, Out& out) {
+		grad<3, 4>(out, 3, 1, col);
+		grad<3, 4>(out, 1, 3, col);
+		grad<1, 4>(out, 3, 0, col);
+		grad<1, 4>(out, 0, 3, col);
+		grad<1, 3>(out, 2, 2, col);
+		out.ref(3, 3) = out.ref(3, 2) = out.ref(2, 3) = col;
+	}
+	template<class Out> static void blendLineDiagonal(u32 col, Out& out) {
+		grad<1, 2>(out, 3, 2, col);
+		grad<1, 2>(out, 2, 3, col);
+		out.ref(3, 3) = col;
+	}
+	template<class Out> static void blendCorner(u32 col, Out& out) {
+		grad<68, 100>(out, 3, 3, col);
+		grad< 9, 100>(out, 3, 2, col);
+		grad< 9, 100>(out, 2, 3, col);
+	}
+};
+
+struct Scaler5x {
+	static const int scale = 5;
+
+	template<class Out> static void blendLineShallow(u32 col, Out& out) {
+		grad<1, 4>(out, 4, 0, col);
+		grad<1, 4>(out, 3, 2, col);
+		grad<1, 4>(out, 2, 4, col);
+		grad<3, 4>(out, 4, 1, col);
+		grad<3, 4>(out, 3, 3, col);
+		out.ref(4, 2) = col;
+		out.ref(4, 3) = col;
+		out.ref(4, 4) = col;
+		out.ref(3, 4) = col;
+	}
+	template<class Out> static void blendLineSteep(u32 col, Out& out) {
+		grad<1, 4>(out, 0, 4, col);
+		grad<1, 4>(out, 2, 3, col);
+		grad<1, 4>(out, 4, 2, col);
+		grad<3, 4>(out, 1, 4, col);
+		grad<3, 4>(out, 3, 3, col);
+		out.ref(2, 4) = col;
+		out.ref(3, 4) = col;
+		out.ref(4, 4) = col;
+		out.ref(4, 3) = col;
+	}
+	template<class Out> static void blendLineSteepAndShallow(u32 col, Out& out) {
+		grad<1, 4>(out, 0, 4, col);
+		grad<1, 4>(out, 2, 3, col);
+		grad<3, 4>(out, 1, 4, col);
+		grad<1, 4>(out, 4, 0, col);
+		grad<1, 4>(out, 3, 2, col);
+		grad<3, 4>(out, 4, 1, col);
+		grad<2, 3>(out, 3, 3, col);
+		out.ref(2, 4) = out.ref(3, 4) = out.ref(4, 4) = col;
+		out.ref(4, 2) = out.ref(4, 3) = col;
+	}
+	template<class Out> static void blendLineDiagonal(u32 col, Out& out) {
+		grad<1, 8>(out, 4, 2, col);
+		grad<1, 8>(out, 3, 3, col);
+		grad<1, 8>(out, 2, 4, col);
+		grad<7, 8>(out, 4, 3, col);
+		grad<7, 8>(out, 3, 4, col);
+		out.ref(4, 4) = col;
+	}
+	template<class Out> static void blendCorner(u32 col, Out& out) {
+		grad<86, 100>(out, 4, 4, col);
+		grad<23, 100>(out, 4, 3, col);
+		grad<23, 100>(out, 3, 4, col);
+	}
+};
+
+struct Scaler6x {
+	static const int scale = 6;
+
+	template<class Out> static void blendLineShallow(u32 col, Out& out) {
+		grad<1, 4>(out, 5, 0, col);
+		grad<1, 4>(out, 4, 2, col);
+		grad<1, 4>(out, 3, 4, col);
+		grad<3, 4>(out, 5, 1, col);
+		grad<3, 4>(out, 4, 3, col);
+		grad<3, 4>(out, 3, 5, col);
+		out.ref(5, 2) = out.ref(5, 3) = out.ref(5, 4) = out.ref(5, 5) = col;
+		out.ref(4, 4) = out.ref(4, 5) = col;
+	}
+	template<class Out> static void blendLineSteep(u32 col, Out& out) {
+		grad<1, 4>(out, 0, 5, col);
+		grad<1, 4>(out, 2, 4, col);
+		grad<1, 4>(out, 4, 3, col);
+		grad<3, 4>(out, 1, 5, col);
+		grad<3, 4>(out, 3, 4, col);
+		grad<3, 4>(out, 5, 3, col);
+		out.ref(2, 5) = out.ref(3, 5) = out.ref(4, 5) = out.ref(5, 5) = col;
+		out.ref(4, 4) = out.ref(5, 4) = col;
+	}
+	template<class Out> static void blendLineSteepAndShallow(u32 col, Out& out) {
+		grad<1, 4>(out, 0, 5, col);
+		grad<1, 4>(out, 2, 4, col);
+		grad<3, 4>(out, 1, 5, col);
+		grad<3, 4>(out, 3, 4, col);
+		grad<1, 4>(out, 5, 0, col);
+		grad<1, 4>(out, 4, 2, col);
+		grad<3, 4>(out, 5, 1, col);
+		grad<3, 4>(out, 4, 3, col);
+		out.ref(2, 5) = out.ref(3, 5) = out.ref(4, 5) = out.ref(5, 5) = col;
+		out.ref(4, 4) = out.ref(5, 4) = col;
+		out.ref(5, 2) = out.ref(5, 3) = col;
+	}
+	template<class Out> static void blendLineDiagonal(u32 col, Out& out) {
+		grad<1, 2>(out, 5, 3, col);
+		grad<1, 2>(out, 4, 4, col);
+		grad<1, 2>(out, 3, 5, col);
+		out.ref(4, 5) = out.ref(5, 5) = out.ref(5, 4) = col;
+	}
+	template<class Out> static void blendCorner(u32 col, Out& out) {
+		grad<97, 100>(out, 5, 5, col);
+		grad<42, 100>(out, 4, 5, col);
+		grad<42, 100>(out, 5, 4, col);
+		grad< 6, 100>(out, 5, 3, col);
+		grad< 6, 100>(out, 3, 5, col);
+	}
+};
+
+struct BlendResult {
+	unsigned char f, g, j, k;
+};
+
+/*
+Detects the blending for the four corners that meet between F, G, J, K,
+with p pointing to F:
+
+| A | B | C | D |
+| E | F | G | H |
+| I | J | K | L |
+| M | N | O | P |
+*/
+template<bool opaque>
+BlendResult preProcessCorners(const u32* p, long V) {
+	BlendResult res = { BLEND_NONE, BLEND_NONE, BLEND_NONE, BLEND_NONE };
+	u32 f = p[0], g = p[1], j = p[V], k = p[V + 1];
+	if ((f == g && j == k) || (f == j && g == k))
+		return res;
+
+	u32 b = p[-V], c = p[-V + 1];
+	u32 e = p[-1], h = p[2];
+	u32 i = p[V - 1], l = p[V + 2];
+	u32 n = p[2*V], o = p[2*V + 1];
+
+	const float weight = 4;
+	float jg = dist<opaque>(i, f) + dist<opaque>(f, c) + dist<opaque>(n, k) + dist<opaque>(k, h) + weight*dist<opaque>(j, g);
+	float fk = dist<opaque>(e, j) + dist<opaque>(j, o) + dist<opaque>(b, g) + dist<opaque>(g, l) + weight*dist<opaque>(f, k);
+
+	if (jg < fk) {
+		unsigned char bt = dominantDirectionThreshold*jg < fk ? BLEND_DOMINANT : BLEND_NORMAL;
+		if (f != g && f != j)
+			res.f = bt;
+		if (k != j && k != g)
+			res.k = bt;
+	} else if (fk < jg) {
+		unsigned char bt = dominantDirectionThreshold*fk < jg ? BLEND_DOMINANT : BLEND_NORMAL;
+		if (j != f && j != k)
+			res.j = bt;
+		if (g != f && g != k)
+			res.g = bt;
+	}
+	return res;
+}
+
+/*
+Blends the bottom right corner of the rotated 3x3 window around E:
+
+| A | B | C |
+| D | E | F |
+| G | H | I |
+*/
+template<class Scaler, int rot, bool opaque>
+void blendPixel(const u32* p, long V, u32* out, long outStride, unsigned char blendInfo) {
+	unsigned char blend = rotateBlendInfo<rot>(blendInfo);
+	if (getBottomR(blend) < BLEND_NORMAL)
+		return;
+
+	auto P = [&](int dx, int dy) { return p[rotatedOffset<rot>(dx, dy, V)]; };
+	u32 b = P( 0, -1), c = P(1, -1);
+	u32 d = P(-1,  0), e = P(0,  0), f = P(1, 0);
+	u32 g = P(-1,  1), h = P(0,  1), i = P(1, 1);
+
+	auto eq = [](u32 x, u32 y) { return dist<opaque>(x, y) < equalColorTolerance; };
+
+	bool doLineBlend = true;
+	if (getBottomR(blend) < BLEND_DOMINANT) {
+		// no second blending in an adjacent rotation, except for 90 degree corners
+		if (getTopR(blend) != BLEND_NONE && !eq(e, g))
+			doLineBlend = false;
+		else if (getBottomL(blend) != BLEND_NONE && !eq(e, c))
+			doLineBlend = false;
+		// no full blending for L-shapes, blend corner only
+		else if (!eq(e, i) && eq(g, h) && eq(h, i) && eq(i, f) && eq(f, c))
+			doLineBlend = false;
+	}
+
+	u32 px = dist<opaque>(e, f) <= dist<opaque>(e, h) ? f : h;
+	OutputMatrix<Scaler::scale, rot, opaque> m(out, outStride);
+
+	if (!doLineBlend) {
+		Scaler::blendCorner(px, m);
+		return;
+	}
+
+	float fg = dist<opaque>(f, g);
+	float hc = dist<opaque>(h, c);
+	bool shallow = steepDirectionThreshold*fg <= hc && e != g && d != g;
+	bool steep   = steepDirectionThreshold*hc <= fg && e != c && b != c;
+
+	if (shallow && steep)
+		Scaler::blendLineSteepAndShallow(px, m);
+	else if (shallow)
+		Scaler::blendLineShallow(px, m);
+	else if (steep)
+		Scaler::blendLineSteep(px, m);
+	else
+		Scaler::blendLineDiagonal(px, m);
+}
+
+// Scales input rows y0..y1-1. Every pixel needs the corner blending
+// detected at all four of its corners. Going left to right and top to
+// bottom, the corners below and to the right are detected at the pixel
+// itself, the others are carried over from the previous row and column.
+// The row above the slice is detected again, rather than taken from the
+// slice above it, so that slices are independent and can run in parallel.
+template<class Scaler, bool opaque>
+void scaleRows(const u32* img, int w, u32* out, int y0, int y1) {
+	const int pad = 2, n = Scaler::scale;
+	long V = w + 2*pad;
+	long outw = (long)n*w;
+
+	// blend info of the current row, one extra entry for x+1 at the end
+	std::vector<unsigned char> info(w + 1, 0);
+
+	const u32* p = img + (long)(y0 - 1 + pad)*V + pad;
+	for (int x = 0; x < w; ++x) {
+		BlendResult res = preProcessCorners<opaque>(p + x, V);
+		setTopR(info[x], res.j);
+		setTopL(info[x + 1], res.k);
+	}
+
+	for (int y = y0; y < y1; ++y) {
+		p = img + (long)(y + pad)*V + pad;
+		u32* dst = out + y*n*outw;
+		unsigned char below = 0; // for (x, y+1)
+
+		for (int x = 0; x < w; ++x, dst += n) {
+			BlendResult res = preProcessCorners<opaque>(p + x, V);
+			unsigned char blend = info[x];
+			setBottomR(blend, res.f);
+			setTopR(below, res.j);
+			info[x] = below;
+			below = 0;
+			setTopL(below, res.k);
+			setBottomL(info[x + 1], res.g);
+
+			for (int r = 0; r < n; ++r)
+				std::fill(dst + r*outw, dst + r*outw + n, p[x]);
+
+			if (blend != 0) {
+				blendPixel<Scaler, 0, opaque>(p + x, V, dst, outw, blend);
+				blendPixel<Scaler, 1, opaque>(p + x, V, dst, outw, blend);
+				blendPixel<Scaler, 2, opaque>(p + x, V, dst, outw, blend);
+				blendPixel<Scaler, 3, opaque>(p + x, V, dst, outw, blend);
+			}
+		}
+	}
+}
+
+// Rows are split into one slice per thread.
+template<class Scaler>
+void scaleXBRZ(u32* img, int w, int h, u32* out) {
+	bool opaque = isOpaque(img, (long)(w + 4)*(h + 4));
+	parallelBands(0, h, [&](int y0, int y1) {
+		if (opaque)
+			scaleRows<Scaler, true>(img, w, out, y0, y1);
+		else
+			scaleRows<Scaler, false>(img, w, out, y0, y1);
+	});
+}
+
+void scaleXBRZ2x(u32* data, int w, int h, u32* out) {
+	scaleXBRZ<Scaler2x>(data, w, h, out);
+}
+
+void scaleXBRZ3x(u32* data, int w, int h, u32* out) {
+	scaleXBRZ<Scaler3x>(data, w, h, out);
+}
+
+void scaleXBRZ4x(u32* data, int w, int h, u32* out) {
+	scaleXBRZ<Scaler4x>(data, w, h, out);
+}
+
+void scaleXBRZ5x(u32* data, int w, int h, u32* out) {
+	scaleXBRZ<Scaler5x>(data, w, h, out);
+}
+
+void scaleXBRZ6x(u32* data, int w, int h, u32* out) {
+	scaleXBRZ<Scaler6x>(data, w, h, out);
+}